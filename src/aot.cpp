@@ -0,0 +1,532 @@
+// aot.cpp
+
+/*
+* Problem: libraries that don't change for months are still re-parsed and interpreted
+    every time the interpreter starts.
+
+* Solution: an ahead-of-time mode (`lisp --aot out.cpp lib.lisp...`) that translates
+    source files into one C++ translation unit. Compiled into a shared object, it links
+    against the runtime (expr.cpp, gc.cpp, builtins.cpp, interpreter.cpp) of the executable
+    that loads it, so the executable must export its symbols (-rdynamic).
+    `(load-native "lib.so")` then calls the exported aot_register, which binds every compiled
+    function as a Native, in source order.
+
+    A top-level `(defun name (args...) body...)` is compiled to a C++ function when its body
+    only uses:
+    - literals and `(quote atom)`,
+    - parameters and global variables,
+    - calls to global functions or to parameters,
+    - `when` and `begin`.
+
+    Every other top-level form, including a defun with a macro call, a lambda or another
+    special form in it, is embedded as source and evaluated when the library is loaded,
+    so the result behaves exactly like `load` on the same files, only faster.
+    Macros defined in the sources are evaluated at compile time to recognize their call sites.
+
+* Differences from the interpreted definition:
+    - Compiled functions are natives, so the optimizer does not inline them into callers.
+    Calls with the wrong number of arguments fail like interpreted ones, with
+    wrong-integer-of-arguments and the number of arguments given.
+*/
+
+#pragma once
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string_view>
+
+#include <dlfcn.h>
+
+#include "aot.hpp"
+#include "builtins.hpp"
+#include "interpreter.hpp"
+#include "parser.hpp"
+#include "tokenizer.hpp"
+
+struct AotCompiler {
+    Gc* gc;
+    Scope* scope;               // compile-time scope: the standard library and the sources' macros
+    Expr params;                // parameters of the defun being compiled
+    std::ostringstream code;    // its statements
+    int temps;
+    int depth;
+};
+
+static std::string c_string_literal(std::string_view str)
+{
+    std::string out = "\"";
+
+    for (unsigned char c : str) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20 || c == 0x7f) {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\%03o", c);
+                out += escape;
+            } else {
+                out += (char) c;
+            }
+        }
+    }
+
+    return out + "\"";
+}
+
+static std::ostream& line(AotCompiler& c)
+{
+    return c.code << std::string(4 * c.depth, ' ');
+}
+
+static std::string new_temp(AotCompiler& c)
+{
+    return "t" + std::to_string(c.temps++);
+}
+
+static long int param_index(Expr params, Expr name)
+{
+    long int index = 0;
+
+    for (; cons_p(params); params = CDR(params), ++index) {
+        if (CAR(params).atom->sym == name.atom->sym) {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+// Emits `Expr var = <value of an atom that evaluates to itself>;`
+static bool compile_constant(AotCompiler& c, Expr expr, std::string* var)
+{
+    std::string value;
+
+    if (nil_p(expr)) {
+        value = "NIL(gc)";
+    } else if (expr.atom == t_atom) {
+        value = "T(gc)";
+    } else if (integer_p(expr)) {
+        value = "INTEGER(gc, " + std::to_string(expr.atom->num) + "L)";
+    } else if (real_p(expr)) {
+        std::ostringstream real;
+        real.precision(std::numeric_limits<double>::max_digits10);
+        real << expr.atom->real;
+        value = "REAL(gc, " + real.str() + ")";
+    } else if (string_p(expr)) {
+        value = "STRING(gc, " + c_string_literal(expr.atom->str) + ")";
+    } else if (symbol_p(expr)) {
+        value = "SYMBOL(gc, " + c_string_literal(expr.atom->sym) + ")";
+    } else {
+        return false;
+    }
+
+    *var = new_temp(c);
+    line(c) << "Expr " << *var << " = " << value << ";\n";
+    return true;
+}
+
+// Emits the checked call and `Expr var = <its result>;`
+static void emit_checked(AotCompiler& c, const std::string& call, std::string* var)
+{
+    const std::string result = "r" + std::to_string(c.temps);
+    *var = new_temp(c);
+
+    line(c) << "EvalResult " << result << " = " << call << ";\n";
+    line(c) << "if (" << result << ".is_error) {\n";
+    line(c) << "    return " << result << ";\n";
+    line(c) << "}\n";
+    line(c) << "Expr " << *var << " = " << result << ".expr;\n";
+}
+
+static bool compile_expr(AotCompiler& c, Expr expr, std::string* var);
+
+static bool compile_block(AotCompiler& c, Expr block, std::string* var)
+{
+    if (nil_p(block)) {
+        *var = new_temp(c);
+        line(c) << "Expr " << *var << " = NIL(gc);\n";
+        return true;
+    }
+
+    for (; !nil_p(block); block = CDR(block)) {
+        if (!compile_expr(c, CAR(block), var)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Evaluates the arguments left to right and conses them into `*var`.
+static bool compile_args(AotCompiler& c, Expr args, std::string* var)
+{
+    std::vector<std::string> values;
+
+    for (; !nil_p(args); args = CDR(args)) {
+        std::string value;
+        if (!compile_expr(c, CAR(args), &value)) {
+            return false;
+        }
+        values.push_back(value);
+    }
+
+    *var = new_temp(c);
+    line(c) << "Expr " << *var << " = NIL(gc);\n";
+    for (auto it = values.rbegin(); it != values.rend(); ++it) {
+        line(c) << *var << " = CONS(gc, " << *it << ", " << *var << ");\n";
+    }
+
+    return true;
+}
+
+static bool compile_when(AotCompiler& c, Expr args, std::string* var)
+{
+    if (!cons_p(args)) {
+        return false;
+    }
+
+    std::string condition;
+    if (!compile_expr(c, CAR(args), &condition)) {
+        return false;
+    }
+
+    *var = new_temp(c);
+    line(c) << "Expr " << *var << " = NIL(gc);\n";
+    line(c) << "if (!nil_p(" << condition << ")) {\n";
+    c.depth++;
+
+    std::string body;
+    if (!compile_block(c, CDR(args), &body)) {
+        return false;
+    }
+    line(c) << *var << " = " << body << ";\n";
+
+    c.depth--;
+    line(c) << "}\n";
+    return true;
+}
+
+static bool compile_symbol(AotCompiler& c, Expr name, std::string* var)
+{
+    if (nil_p(name) || name.atom == t_atom) {
+        return compile_constant(c, name, var);
+    }
+
+    const long int index = param_index(c.params, name);
+    if (index >= 0) {
+        *var = "params[" + std::to_string(index) + "]";
+        return true;
+    }
+
+    emit_checked(c, "aot_global_value(gc, scope, " + c_string_literal(name.atom->sym) + ")", var);
+    return true;
+}
+
+/*
+* Emits the statements computing `expr`; `*var` names the C++ variable holding its value.
+    Returns false if `expr` is outside of the compiled subset.
+*/
+static bool compile_expr(AotCompiler& c, Expr expr, std::string* var)
+{
+    if (symbol_p(expr)) {
+        return compile_symbol(c, expr, var);
+    }
+
+    if (expr.type == EXPR_ATOM) {
+        return compile_constant(c, expr, var);
+    }
+
+    Expr head = CAR(expr);
+    Expr args = CDR(expr);
+
+    if (!list_p(expr) || !symbol_p(head)) {
+        return false;
+    }
+
+    std::string arg_list;
+
+    const long int index = param_index(c.params, head);
+    if (index >= 0) {
+        if (!compile_args(c, args, &arg_list)) {
+            return false;
+        }
+        emit_checked(c, "apply_callable(gc, scope, params[" + std::to_string(index) + "], " + arg_list + ")", var);
+        return true;
+    }
+
+    const std::string& name = head.atom->sym;
+
+    if (name == "quote") {
+        return cons_p(args) && nil_p(CDR(args)) && CAR(args).type == EXPR_ATOM
+            && compile_constant(c, CAR(args), var);
+    }
+
+    if (name == "when") {
+        return compile_when(c, args, var);
+    }
+
+    if (name == "begin") {
+        return compile_block(c, args, var);
+    }
+
+    Expr binding = get_scope_value(c.scope, head);
+    if (is_special(name) || (!nil_p(binding) && macro_p(CDR(binding)))) {
+        return false;
+    }
+
+    if (!compile_args(c, args, &arg_list)) {
+        return false;
+    }
+    emit_checked(c, "aot_call(gc, scope, " + c_string_literal(name) + ", " + arg_list + ")", var);
+    return true;
+}
+
+/*
+* Compiles `(defun name (params...) body...)` into `static EvalResult aot_fn_<index>(...)`.
+    Nothing is written to `out` if the form is not a compilable defun.
+*/
+static bool compile_defun(AotCompiler& c, Expr form, int index, std::ostream& out, std::string* name)
+{
+    if (!list_p(form) || length_of_list(form) < 3
+        || !symbol_p(CAR(form)) || CAR(form).atom->sym != "defun") {
+        return false;
+    }
+
+    Expr fn_name = CAR(CDR(form));
+    Expr params = CAR(CDR(CDR(form)));
+    Expr body = CDR(CDR(CDR(form)));
+
+    if (!symbol_p(fn_name) || !list_of_symbols_p(params)) {
+        return false;
+    }
+
+    const long int arity = length_of_list(params);
+
+    c.params = params;
+    c.code.str("");
+    c.temps = 0;
+    c.depth = 1;
+
+    std::string result;
+    if (!compile_block(c, body, &result)) {
+        return false;
+    }
+
+    *name = fn_name.atom->sym;
+
+    out << "// " << *name << "\n";
+    out << "static EvalResult aot_fn_" << index << "(void* param, Gc* gc, Scope* scope, Expr args)\n";
+    out << "{\n";
+    out << "    (void) param;\n";
+    out << "    Expr params[" << (arity > 0 ? arity : 1) << "];\n";
+    out << "    EvalResult bound = aot_bind_args(gc, args, params, " << arity << ");\n";
+    out << "    if (bound.is_error) {\n";
+    out << "        return bound;\n";
+    out << "    }\n";
+    out << c.code.str();
+    out << "    return eval_success(" << result << ");\n";
+    out << "}\n\n";
+
+    return true;
+}
+
+static bool read_source(const std::string& filename, std::string* source)
+{
+    std::ifstream stream(filename, std::ios::binary);
+    if (!stream) {
+        return false;
+    }
+
+    source->assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool aot_compile_files(Gc* gc,
+                       Scope* scope,
+                       const std::vector<std::string>& filenames,
+                       std::ostream& out,
+                       std::ostream& errors)
+{
+    assert(gc);
+    assert(scope);
+
+    AotCompiler c = {
+        .gc = gc,
+        .scope = scope,
+        .params = NIL(gc),
+    };
+
+    std::ostringstream functions;
+    std::ostringstream registrations;
+    int index = 0;
+
+    for (const std::string& filename : filenames) {
+        std::string source;
+        if (!read_source(filename, &source)) {
+            errors << filename << ": could not read file" << std::endl;
+            return false;
+        }
+
+        const char* cursor = next_token(source.c_str()).begin;
+
+        while (*cursor != 0) {
+            ParseResult parse_result = read_expr_from_string(gc, cursor);
+            if (parse_result.is_error) {
+                errors << filename << ": " << parse_result.error_message << std::endl;
+                return false;
+            }
+
+            Expr form = parse_result.expr;
+            std::string name;
+
+            if (compile_defun(c, form, index, functions, &name)) {
+                registrations << "    aot_define(gc, scope, " << c_string_literal(name)
+                              << ", aot_fn_" << index << ");\n";
+                index++;
+            } else {
+                if (cons_p(form) && symbol_p(CAR(form)) && CAR(form).atom->sym == "defmacro") {
+                    EvalResult result = eval(gc, scope, form);
+                    if (result.is_error) {
+                        errors << filename << ": could not define macro" << std::endl;
+                        return false;
+                    }
+                }
+
+                registrations << "    result = aot_eval_source(gc, scope, "
+                              << c_string_literal(std::string(cursor, parse_result.end)) << ");\n";
+                registrations << "    if (result.is_error) {\n";
+                registrations << "        return result;\n";
+                registrations << "    }\n";
+            }
+
+            cursor = next_token(parse_result.end).begin;
+        }
+    }
+
+    out << "// Generated by aot_compile_files (aot.cpp) from:\n";
+    for (const std::string& filename : filenames) {
+        out << "//   " << filename << "\n";
+    }
+    out << "\n";
+    out << "#include \"aot.hpp\"\n";
+    out << "#include \"builtins.hpp\"\n";
+    out << "#include \"interpreter.hpp\"\n\n";
+    out << functions.str();
+    out << "extern \"C\" EvalResult " << AOT_REGISTER_SYMBOL << "(Gc* gc, Scope* scope)\n";
+    out << "{\n";
+    out << "    EvalResult result = eval_success(NIL(gc));\n";
+    out << registrations.str();
+    out << "    return result;\n";
+    out << "}\n";
+
+    return static_cast<bool>(out);
+}
+
+/*
+* The shared object is never closed: the natives it registered point into it
+    and may be referenced from anywhere in the heap.
+*/
+EvalResult aot_load_native(Gc* gc, Scope* scope, const char* filename)
+{
+    void* handle = dlopen(filename, RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+        return eval_failure(list(gc, "qs", "load-native-error", dlerror()));
+    }
+
+    AotRegister aot_register = reinterpret_cast<AotRegister>(dlsym(handle, AOT_REGISTER_SYMBOL));
+    if (aot_register == nullptr) {
+        dlclose(handle);
+        return eval_failure(list(gc, "qs", "load-native-error", "no aot_register in shared object"));
+    }
+
+    return aot_register(gc, scope);
+}
+
+// Binds exactly `count` arguments, failing with the same errors as apply_lambda.
+EvalResult aot_bind_args(Gc* gc, Expr args, Expr* params, long int count)
+{
+    if (!list_p(args)) {
+        return eval_failure(CONS(gc, SYMBOL(gc, "expected-arguments"), args));
+    }
+
+    if (length_of_list(args) != count) {
+        return wrong_integer_of_arguments(gc, length_of_list(args));
+    }
+
+    for (long int i = 0; i < count; ++i) {
+        params[i] = CAR(args);
+        args = CDR(args);
+    }
+
+    return eval_success(NIL(gc));
+}
+
+// Compiled code only ever sees the global frame, the one its defun was evaluated in.
+EvalResult aot_global_value(Gc* gc, Scope* scope, const char* name)
+{
+    Expr frames = scope->expr;
+
+    while (cons_p(frames) && cons_p(frames.cons->cdr)) {
+        frames = frames.cons->cdr;
+    }
+
+    if (cons_p(frames)) {
+        for (Expr frame = frames.cons->car; cons_p(frame); frame = frame.cons->cdr) {
+            Expr binding = frame.cons->car;
+            if (CAR(binding).atom->sym == name) {
+                return eval_success(CDR(binding));
+            }
+        }
+    }
+
+    return eval_failure(CONS(gc, SYMBOL(gc, "void-variable"), SYMBOL(gc, name)));
+}
+
+// Compiled calls bypass eval_funcall, so they spend their step of the budget
+// and count their nesting against Gc::max_eval_depth here.
+EvalResult aot_call(Gc* gc, Scope* scope, const char* name, Expr args)
+{
+    if (gc->eval_depth >= gc->max_eval_depth) {
+        return eval_failure(CONS(gc,
+                                 SYMBOL(gc, "stack-overflow"),
+                                 INTEGER(gc, (long int) gc->max_eval_depth)));
+    }
+
+    EvalResult step = eval_step(gc);
+    if (step.is_error) {
+        return step;
+    }
+
+    EvalResult callable = aot_global_value(gc, scope, name);
+    if (callable.is_error) {
+        return callable;
+    }
+
+    gc->eval_depth++;
+    EvalResult result = apply_callable(gc, scope, callable.expr, args);
+    gc->eval_depth--;
+
+    return result;
+}
+
+void aot_define(Gc* gc, Scope* scope, const char* name, NativeFunction fun)
+{
+    set_scope_value(gc, scope, SYMBOL(gc, name), NATIVE(gc, fun, NULL));
+}
+
+EvalResult aot_eval_source(Gc* gc, Scope* scope, const char* source)
+{
+    ParseResult parse_result = read_expr_from_string(gc, source);
+    if (parse_result.is_error) {
+        return read_error(gc, parse_result.error_message, parse_result.end - source);
+    }
+
+    return eval(gc, scope, parse_result.expr);
+}
@@ -0,0 +1,42 @@
+#ifndef AOT_H_
+#define AOT_H_
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "expr.hpp"
+#include "gc.hpp"
+#include "scope.hpp"
+
+// Every translation unit produced by aot_compile_files exports this function.
+#define AOT_REGISTER_SYMBOL "aot_register"
+
+using AotRegister = EvalResult (*)(Gc* gc, Scope* scope);
+
+/*
+* Translates Lisp source files into one C++ translation unit.
+    Returns false and reports to `errors` if a file can't be read or parsed.
+*/
+bool aot_compile_files(Gc* gc,
+                       Scope* scope,
+                       const std::vector<std::string>& filenames,
+                       std::ostream& out,
+                       std::ostream& errors);
+
+/*
+* Loads a shared object built from aot_compile_files output and registers its functions.
+*/
+EvalResult aot_load_native(Gc* gc, Scope* scope, const char* filename);
+
+// Runtime support called by generated code.
+
+EvalResult aot_bind_args(Gc* gc, Expr args, Expr* params, long int count);
+EvalResult aot_global_value(Gc* gc, Scope* scope, const char* name);
+EvalResult aot_call(Gc* gc, Scope* scope, const char* name, Expr args);
+void aot_define(Gc* gc, Scope* scope, const char* name, NativeFunction fun);
+EvalResult aot_eval_source(Gc* gc, Scope* scope, const char* source);
+
+#endif  // AOT_H_
@@ -52,6 +52,10 @@ static bool equal_atoms(const Atom* atom1, const Atom* atom2) {
         return atom1->str == atom2->str;
 
     case Atom::ATOM_LAMBDA:
+    case Atom::ATOM_MACRO:
+    case Atom::ATOM_WEAK_BOX:
+    case Atom::ATOM_WEAK_TABLE:
+    case Atom::ATOM_STRING_BUILDER:
         return atom1 == atom2;
 
     case Atom::ATOM_NATIVE:
@@ -61,35 +65,34 @@ static bool equal_atoms(const Atom* atom1, const Atom* atom2) {
     return false;
 }
 
-/*
-* Compares two cons cells for equality by recursively checking equality of both their car and cdr parts.
-    
-    Cons is the fundamental building blocks of lists in Lisp, cons cells have two parts: car and cdr, 
-    representing the first element and the rest of the list, respectively.
-    
-*/
-static bool equal_cons(const Cons* cons1, const Cons* cons2) {
-    assert(cons1);
-    assert(cons2);
-    return equal(&cons1->car, &cons2->car) && equal(&cons1->cdr, &cons2->cdr);
-}
-
 /*
 * Determines if two expressions are equal by comparing their types 
-    (atom, cons cell, or void) and then delegating to equal_atoms or equal_cons as appropriate.
+    (atom, cons cell, or void) and then delegating to equal_atoms as appropriate.
+
+    Cons cells are equal when their cars and cdrs are. Lists are walked along the cdr in a loop
+    and only the cars recurse, so the depth of the C++ stack follows the nesting, not the length.
 */
 bool equal(const Expr& obj1, const Expr& obj2) {
-    if (obj1.type != obj2.type) {
+    Expr a = obj1;
+    Expr b = obj2;
+
+    while (a.type == Expr::EXPR_CONS && b.type == Expr::EXPR_CONS) {
+        if (!equal(a.cons.car, b.cons.car)) {
+            return false;
+        }
+        a = a.cons.cdr;
+        b = b.cons.cdr;
+    }
+
+    if (a.type != b.type) {
         return false;
     }
 
-    switch (obj1.type) {
+    switch (a.type) {
     case Expr::EXPR_ATOM:
-        return equal_atoms(&obj1.atom, &obj2.atom);
+        return equal_atoms(&a.atom, &b.atom);
 
     case Expr::EXPR_CONS:
-        return equal_cons(&obj1.cons, &obj2.cons);
-
     case Expr::EXPR_VOID:
         return true;
     }
@@ -108,9 +111,9 @@ bool equal(const Expr& obj1, const Expr& obj2) {
 */
 
 
-// Check if an expression is nil.
+// Check if an expression is nil. nil is canonical, so this is a pointer comparison.
 bool nil_p(const Expr& obj) {
-    return symbol_p(obj) && obj.atom.sym == "nil";
+    return obj.type == EXPR_ATOM && obj.atom == nil_atom;
 }
 
 // Check if an expression is symbol.
@@ -140,28 +143,24 @@ bool cons_p(const Expr& obj) {
 
 // Check if an expression is a list.
 bool list_p(const Expr& obj) {
-    if (nil_p(obj)) {
-        return true;
-    }
+    Expr xs = obj;
 
-    if (obj.type == Expr::EXPR_CONS) {
-        return list_p(obj.cons.cdr);
+    while (xs.type == Expr::EXPR_CONS) {
+        xs = xs.cons.cdr;
     }
 
-    return false;
+    return nil_p(xs);
 }
 
 // Check if an expression is a list of symbols.
 bool list_of_symbols_p(const Expr& obj) {
-    if (nil_p(obj)) {
-        return true;
-    }
+    Expr xs = obj;
 
-    if (obj.type == Expr::EXPR_CONS && symbol_p(obj.cons.car)) {
-        return list_of_symbols_p(obj.cons.cdr);
+    while (xs.type == Expr::EXPR_CONS && symbol_p(xs.cons.car)) {
+        xs = xs.cons.cdr;
     }
 
-    return false;
+    return nil_p(xs);
 }
 
 // Check if an expression is a lambda.
@@ -169,6 +168,26 @@ bool lambda_p(const Expr& obj) {
     return obj.type == Expr::EXPR_ATOM && obj.atom.type == Atom::ATOM_LAMBDA;
 }
 
+// Check if an expression is a macro.
+bool macro_p(const Expr& obj) {
+    return obj.type == EXPR_ATOM && obj.atom->type == ATOM_MACRO;
+}
+
+// Check if an expression is a weak box.
+bool weak_box_p(const Expr& obj) {
+    return obj.type == EXPR_ATOM && obj.atom->type == ATOM_WEAK_BOX;
+}
+
+// Check if an expression is a weak table.
+bool weak_table_p(const Expr& obj) {
+    return obj.type == EXPR_ATOM && obj.atom->type == ATOM_WEAK_TABLE;
+}
+
+// Check if an expression is a string builder.
+bool string_builder_p(const Expr& obj) {
+    return obj.type == EXPR_ATOM && obj.atom->type == ATOM_STRING_BUILDER;
+}
+
 // Calculate length of the list.
 long int length_of_list(const Expr& obj) {
     long int count = 0;
@@ -181,17 +200,17 @@ long int length_of_list(const Expr& obj) {
     return count;
 }
 
-// Some special forms.
-constexpr std::string specials[] = {
-    "set", "quote", "begin",
-    "defun", "lambda", "λ",
-    "when", "quasiquote"
+// Some special forms. Kept sorted, is_special does a binary search.
+static const std::string specials[] = {
+    "and", "begin", "case", "catch", "cond", "condition-case", "defconst", "defmacro", "defun",
+    "dolist", "dotimes", "if", "lambda", "let", "let*", "letrec", "or",
+    "quasiquote", "quote", "set", "when", "while", "λ"
 };
 
 // Check if a string is a special form.
 bool is_special(const std::string& name) {
     assert(!name.empty());
-    return binary_search(specials.begin(), specials.end(), name);
+    return std::binary_search(std::begin(specials), std::end(specials), name);
 }
 
 /*
@@ -273,9 +292,9 @@ Expr list(const std::string& format, ...) {
 
 /*
 * The bool_as_expr function takes a boolean value and returns a Lisp expression that represents a Lisp boolean.
+    Both answers are the canonical t and nil, so nothing is allocated.
 */
 Expr bool_as_expr(bool condition) {
-    return condition ? Expr{ .type = Expr::EXPR_ATOM, .atom = {.type = Atom::ATOM_ATOM, .atom = T} }
-    : Expr{ .type = Expr::EXPR_ATOM, .atom = {.type = Atom::ATOM_ATOM, .atom = NIL} };
+    return atom_as_expr(condition ? t_atom : nil_atom);
 }
     
\ No newline at end of file
@@ -19,6 +19,10 @@ bool cons_p(const Expr& obj);
 bool list_p(const Expr& obj);
 bool list_of_symbols_p(const Expr& obj);
 bool lambda_p(const Expr& obj);
+bool macro_p(const Expr& obj);
+bool weak_box_p(const Expr& obj);
+bool weak_table_p(const Expr& obj);
+bool string_builder_p(const Expr& obj);
 
 bool is_special(const std::string& name);
 
@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <assert.h>
 #include <stdio.h>
 #include <new>
@@ -25,6 +26,9 @@
 #include <string.h>
 
 #include "expr.hpp"
+#include "gc.hpp"
+#include "jit.hpp"
+#include "str.hpp"
 
 // Create an Expr from an Atom.
 Expr atom_as_expr(const Atom& atom)
@@ -96,6 +100,22 @@ void print_atom_as_sexpr(FILE *stream, const Atom& atom)
     case ATOM_NATIVE: {
         fprintf(stream, "<native>");
     } break;
+
+    case ATOM_MACRO: {
+        fprintf(stream, "<macro>");
+    } break;
+
+    case ATOM_WEAK_BOX: {
+        fprintf(stream, "<weak-box>");
+    } break;
+
+    case ATOM_WEAK_TABLE: {
+        fprintf(stream, "<weak-table>");
+    } break;
+
+    case ATOM_STRING_BUILDER: {
+        fprintf(stream, "<string-builder>");
+    } break;
     }
 }
 
@@ -120,8 +140,7 @@ void print_cons_as_sexpr(FILE *stream, Cons *head)
         print_expr_as_sexpr(stream, cons->car);
     }
 
-    if (cons->cdr.atom->type != ATOM_SYMBOL ||
-        strcmp("nil", cons->cdr.atom->sym) != 0) {
+    if (cons->cdr.type != EXPR_ATOM || cons->cdr.atom != nil_atom) {
         fprintf(stream, " . ");
         print_expr_as_sexpr(stream, cons->cdr);
     }
@@ -182,12 +201,31 @@ void destroy_expr(Expr expr)
 */
     
 
+// Allocates one of the canonical symbols. They live outside of any Gc.
+// With compressed references they still have to be inside the heap reservation.
+static Atom *create_canonical_symbol(const char *name)
+{
+#ifdef COMPRESSED_REFS
+    static Atom *const canonical = static_cast<Atom*>(heap_map(ARENA_CHUNK_SIZE));
+    static size_t count = 0;
+    Atom *atom = new (&canonical[count++]) Atom;
+#else
+    Atom *atom = new Atom;
+#endif
+    atom->type = ATOM_SYMBOL;
+    new (&atom->sym) std::string(name);
+    return atom;
+}
+
+Atom *const nil_atom = create_canonical_symbol("nil");
+Atom *const t_atom = create_canonical_symbol("t");
+
 /*
 * Takes two Expr objects (car and cdr) to create a new cons cell.
 */
 Cons *create_cons(Gc *gc, Expr car, Expr cdr)
 {
-    Cons *cons = new Cons;
+    Cons *cons = gc_new<Cons>(gc);
     cons->car = car;
     cons->cdr = cdr;
 
@@ -196,6 +234,43 @@ Cons *create_cons(Gc *gc, Expr car, Expr cdr)
     return cons;
 }
 
+/*
+* Builds the list of `items` ending in `tail`.
+    The conses are allocated as adjacent runs (see gc_new_run), so walking the list,
+    as length_of_list or dolist do, reads memory sequentially. They are ordinary conses
+    in every other respect: each is registered, swept and freed on its own,
+    and mutating a cdr needs no special care.
+*/
+Expr list_from_array(Gc *gc, const Expr *items, size_t count, Expr tail)
+{
+    Expr head = tail;
+    Cons *previous = NULL;
+    size_t built = 0;
+
+    while (built < count) {
+        size_t run = 0;
+        Cons *cells = gc_new_run<Cons>(gc, count - built, &run);
+
+        for (size_t i = 0; i < run; ++i) {
+            Cons *cons = &cells[i];
+            cons->car = items[built + i];
+            cons->cdr = tail;
+            gc_add_expr(gc, cons_as_expr(cons));
+
+            if (previous == NULL) {
+                head = cons_as_expr(cons);
+            } else {
+                previous->cdr = cons_as_expr(cons);
+            }
+            previous = cons;
+        }
+
+        built += run;
+    }
+
+    return head;
+}
+
 /*
 * Frees the memory allocated for a cons cell. 
     This function is straightforward 
@@ -203,7 +278,7 @@ Cons *create_cons(Gc *gc, Expr car, Expr cdr)
 */
 void destroy_cons(Cons *cons)
 {
-    delete cons;
+    arena_free(cons);
 }
 
 /*
@@ -214,23 +289,20 @@ void destroy_cons(Cons *cons)
     (real, integer, string, symbol, lambda, and native function, respectively). 
 
     They set the appropriate type and content for the atom, 
-    and then attempt to register the atom with the GC. 
+    and then register the atom with the GC. 
 
-    If registration fails, these functions clean up by deallocating the atom and return NULL, 
-    indicating failure.
+    Registration cannot fail: over a memory limit gc_add_expr throws MemoryExhausted
+    once the atom is tracked, and the collector frees it like any other.
 */
 
 //  Create a real Atom.
 Atom *create_real_atom(Gc *gc, float real)
 {
-    Atom *atom = new Atom;
+    Atom *atom = gc_new<Atom>(gc);
     atom->type = ATOM_REAL;
     atom->real = real;
 
-    if (gc_add_expr(gc, atom_as_expr(atom)) < 0) {
-        delete atom;
-        return NULL;
-    }
+    gc_add_expr(gc, atom_as_expr(atom));
 
     return atom;
 }
@@ -238,137 +310,192 @@ Atom *create_real_atom(Gc *gc, float real)
 // Create an integer Atom.
 Atom *create_integer_atom(Gc *gc, long int num)
 {
-    Atom *atom = new Atom;
+    Atom *atom = gc_new<Atom>(gc);
     atom->type = ATOM_INTEGER;
     atom->num = num;
 
-    if (gc_add_expr(gc, atom_as_expr(atom)) < 0) {
-        delete atom;
-        return NULL;
-    }
+    gc_add_expr(gc, atom_as_expr(atom));
 
     return atom;
 }
 
-// Create a string Atom.
-Atom *create_string_atom(Gc *gc, const std::string& str, const std::string& str_end)
+// Create a string Atom from the characters in [str, str_end).
+// A null `str_end` means `str` is NUL-terminated.
+Atom *create_string_atom(Gc *gc, const char* str, const char* str_end)
 {
-    Atom *atom = new Atom;
+    Atom *atom = gc_new<Atom>(gc);
+    atom->type = ATOM_STRING;
+    const size_t n = str_end == NULL ? strlen(str) : (size_t) (str_end - str);
+    new (&atom->str) LispString(str, n);
 
-    if (atom == NULL) {
-        goto error;
-    }
+    gc_add_expr(gc, atom_as_expr(atom));
 
-    atom->type = ATOM_STRING;
-    atom->str = string_duplicate(str, str_end);
+    return atom;
+}
+
+// Create a symbol Atom from the characters in [sym, sym_end).
+// A null `sym_end` means `sym` is NUL-terminated.
+Atom *create_symbol_atom(Gc *gc, const char* sym, const char* sym_end)
+{
+    const size_t n = sym_end == nullptr ? strlen(sym) : (size_t) (sym_end - sym);
 
-    if (atom->str == NULL) {
-        goto error;
+    if (n == 3 && memcmp(sym, "nil", 3) == 0) {
+        return nil_atom;
     }
 
-    if (gc_add_expr(gc, atom_as_expr(atom)) < 0) {
-        goto error;
+    if (n == 1 && sym[0] == 't') {
+        return t_atom;
     }
 
-    return atom;
+    Atom *atom = gc_new<Atom>(gc);
+    atom->type = ATOM_SYMBOL;
+    new (&atom->sym) std::string(sym, n);
 
-error:
-    if (atom != NULL) {
-        if (atom->str != NULL) {
-            delete[] atom->str;
-        }
-        delete atom;
-    }
+    gc_add_expr(gc, atom_as_expr(atom));
 
-    return NULL;
+    return atom;
 }
 
-// Create a symbol Atom.
-Atom *create_symbol_atom(Gc *gc, const std::string& sym, const std::string& sym_end)
+// Create a lambda Atom.
+Atom *create_lambda_atom(Gc *gc, Expr args_list, Expr body, Expr envir)
 {
-    Atom *atom = new Atom;
+    Atom *atom = gc_new<Atom>(gc);
+    atom->type = ATOM_LAMBDA;
+    atom->lambda.args_list = args_list;
+    atom->lambda.body = body;
+    atom->lambda.envir = envir;
+    atom->lambda.optimized = body;
+    atom->lambda.epoch = 0;
+    atom->lambda.calls = 0;
+    atom->lambda.deopts = 0;
+    atom->lambda.jit = nullptr;
+    atom->lambda.frame_escapes = true;
 
-    if (atom == NULL) {
-        goto error;
-    }
+    gc_add_expr(gc, atom_as_expr(atom));
 
-    atom->type = ATOM_SYMBOL;
-    atom->sym = string_duplicate(sym, sym_end);
+    return atom;
+}
 
-    if (atom->sym == NULL) {
-        goto error;
-    }
+// Create a native Atom.
+Atom *create_native_atom(Gc *gc, NativeFunction fun, void *param)
+{
+    Atom *atom = gc_new<Atom>(gc);
+    atom->type = ATOM_NATIVE;
+    atom->native.fun = fun;
+    atom->native.param = param;
+    atom->native.pure = false;
+    atom->native.borrows_args = false;
 
-    if (gc_add_expr(gc, atom_as_expr(atom)) < 0) {
-        goto error;
-    }
+    gc_add_expr(gc, atom_as_expr(atom));
 
     return atom;
+}
+
+// Create a macro Atom. A macro is a lambda whose result is evaluated in place of the call.
+Atom *create_macro_atom(Gc *gc, Expr args_list, Expr body, Expr envir)
+{
+    Atom *atom = create_lambda_atom(gc, args_list, body, envir);
 
-error:
     if (atom != NULL) {
-        if (atom->sym != NULL) {
-            delete[] atom->sym;
-        }
-        delete atom;
+        atom->type = ATOM_MACRO;
     }
 
-    return NULL;
+    return atom;
 }
 
-// Create a lambda Atom.
-Atom *create_lambda_atom(Gc *gc, Expr args_list, Expr body, Expr envir)
+// Create a weak box, which refers to `value` until the collector finds nothing else does.
+Atom *create_weak_box_atom(Gc *gc, Expr value)
 {
-    Atom *atom = new Atom;
+    Atom *atom = gc_new<Atom>(gc);
+    atom->type = ATOM_WEAK_BOX;
+    atom->weak = value;
 
-    if (atom == NULL) {
-        goto error;
-    }
+    gc_add_expr(gc, atom_as_expr(atom));
 
-    atom->type = ATOM_LAMBDA;
-    atom->lambda.args_list = args_list;
-    atom->lambda.body = body;
-    atom->lambda.envir = envir;
+    return atom;
+}
 
-    if (gc_add_expr(gc, atom_as_expr(atom)) < 0) {
-        goto error;
-    }
+// Create an empty weak table.
+Atom *create_weak_table_atom(Gc *gc)
+{
+    Atom *atom = gc_new<Atom>(gc);
+    atom->type = ATOM_WEAK_TABLE;
+    atom->table = new WeakTable;
+
+    gc_add_expr(gc, atom_as_expr(atom));
 
     return atom;
+}
 
-error:
-    if (atom != NULL) {
-        delete atom;
-    }
+// Create an empty string builder.
+Atom *create_string_builder_atom(Gc *gc)
+{
+    Atom *atom = gc_new<Atom>(gc);
+    atom->type = ATOM_STRING_BUILDER;
+    atom->builder = new StringBuilder { {}, 0 };
+
+    gc_add_expr(gc, atom_as_expr(atom));
 
-    return NULL;
+    return atom;
 }
 
-// Create a native Atom.
-Atom *create_native_atom(Gc *gc, NativeFunction fun, void *param)
+/*
+* Appends a string atom to the rope. The caller stores `string` into an older object,
+    so it must have gone through gc_write_barrier (see SbAppendFn).
+* Only copied text is charged, a shared piece already was as a string atom.
+*/
+void string_builder_append(Gc *gc, StringBuilder *builder, Expr string)
 {
-    Atom *atom = new Atom;
+    const LispString &text = string.atom->str;
 
-    if (atom == NULL) {
-        goto error;
+    if (text.size() >= ROPE_SHARE_THRESHOLD) {
+        builder->length += text.size();
+        builder->pieces.push_back(RopePiece { {}, string });
+        return;
     }
 
-    atom->type = ATOM_NATIVE;
-    atom->native.fun = fun;
-    atom->native.param = param;
+    gc_charge(gc, text.size());
+    builder->length += text.size();
 
-    if (gc_add_expr(gc, atom_as_expr(atom)) < 0) {
-        goto error;
+    if (builder->pieces.empty() || builder->pieces.back().shared.type != EXPR_VOID) {
+        builder->pieces.push_back(RopePiece { {}, void_expr() });
     }
 
-    return atom;
+    LispString &tail = builder->pieces.back().text;
+    if (tail.size() + text.size() > tail.capacity()) {
+        tail.reserve(std::max(2 * tail.capacity(), tail.size() + text.size()));
+    }
+    tail.append(text);
+}
 
-error:
-    if (atom != NULL) {
-        delete atom;
+// Returns the built string, copying every piece once into a string of the final size.
+Expr string_builder_flatten(Gc *gc, Atom *atom)
+{
+    StringBuilder *builder = atom->builder;
+
+    if (builder->pieces.size() == 1 && builder->pieces[0].shared.type != EXPR_VOID) {
+        return builder->pieces[0].shared;
+    }
+
+    Expr string = atom_as_expr(create_string_atom(gc, "", NULL));
+    LispString &text = string.atom->str;
+    text.reserve(builder->length);
+    gc_charge(gc, text.capacity());
+
+    for (const RopePiece &piece : builder->pieces) {
+        text.append(piece.shared.type != EXPR_VOID ? piece.shared.atom->str : piece.text);
     }
 
-    return NULL;
+    builder->pieces.clear();
+    builder->pieces.push_back(RopePiece { {}, gc_write_barrier(gc, atom, string) });
+
+    return builder->pieces[0].shared;
+}
+
+// The address of the cons or atom, which tells objects apart.
+const void *expr_identity(const Expr &expr)
+{
+    return expr.type == EXPR_CONS ? (const void*) expr.cons : (const void*) expr.atom;
 }
 
 /*
@@ -376,28 +503,63 @@ error:
     For ATOM_SYMBOL and ATOM_STRING, where strings are dynamically allocated, 
     it also frees the memory for the string before freeing the atom itself.
     
-    For other atom types (like ATOM_LAMBDA, ATOM_NATIVE, ATOM_INTEGER, and ATOM_REAL),
+    A lambda also releases its compiled code, if the JIT produced any.
+
+    For other atom types (like ATOM_NATIVE, ATOM_INTEGER, and ATOM_REAL),
     there's no extra dynamically allocated memory directly associated with the atom, 
     so it simply deletes the atom.
+
+    finalize_atom only releases what the atom owns, for atoms whose own memory
+    is freed in bulk (see gc_end_request).
 */
 
-void destroy_atom(Atom *atom)
+bool atom_owns_memory(const Atom *atom)
+{
+    return atom->type == ATOM_SYMBOL
+        || atom->type == ATOM_STRING
+        || atom->type == ATOM_LAMBDA
+        || atom->type == ATOM_WEAK_TABLE
+        || atom->type == ATOM_STRING_BUILDER;
+}
+
+void finalize_atom(Atom *atom)
 {
     switch (atom->type) {
-    case ATOM_SYMBOL:
+    case ATOM_SYMBOL: {
+        using std::string;
+        atom->sym.~string();
+    } break;
+
     case ATOM_STRING: {
-        delete[] atom->str;
+        atom->str.~LispString();
     } break;
 
-    case ATOM_LAMBDA:
+    case ATOM_LAMBDA: {
+        jit_release(atom->lambda.jit);
+    } break;
+
+    case ATOM_WEAK_TABLE: {
+        delete atom->table;
+    } break;
+
+    case ATOM_STRING_BUILDER: {
+        delete atom->builder;
+    } break;
+
+    case ATOM_WEAK_BOX:
+    case ATOM_MACRO:
     case ATOM_NATIVE:
     case ATOM_INTEGER:
     case ATOM_REAL: {
         /* Nothing */
     } break;
     }
+}
 
-    delete atom;
+void destroy_atom(Atom *atom)
+{
+    finalize_atom(atom);
+    arena_free(atom);
 }
 
 // ### Converting Atoms and Cons to S-expressions String Representation.
@@ -446,6 +608,18 @@ int atom_as_sexpr(Atom *atom, std::string output, size_t n)
 
     case ATOM_NATIVE:
         return snprintf(output, n, "<native>");
+
+    case ATOM_MACRO:
+        return snprintf(output, n, "<macro>");
+
+    case ATOM_WEAK_BOX:
+        return snprintf(output, n, "<weak-box>");
+
+    case ATOM_WEAK_TABLE:
+        return snprintf(output, n, "<weak-table>");
+
+    case ATOM_STRING_BUILDER:
+        return snprintf(output, n, "<string-builder>");
     }
 
     return 0;
@@ -485,8 +659,7 @@ int cons_as_sexpr(Cons* head, char* output, size_t n)
         }
     }
 
-    if (cons->cdr.atom->type != ATOM_SYMBOL ||
-        strcmp("nil", cons->cdr.atom->sym) != 0) {
+    if (cons->cdr.type != EXPR_ATOM || cons->cdr.atom != nil_atom) {
 
         c += snprintf(output + c, (size_t)(m - c), " . ");
         if (m - c <= 0) {
@@ -563,6 +736,10 @@ const std::string& atom_type_as_string(AtomType atom_type)
     case ATOM_STRING: return "ATOM_STRING";
     case ATOM_LAMBDA: return "ATOM_LAMBDA";
     case ATOM_NATIVE: return "ATOM_NATIVE";
+    case ATOM_MACRO: return "ATOM_MACRO";
+    case ATOM_WEAK_BOX: return "ATOM_WEAK_BOX";
+    case ATOM_WEAK_TABLE: return "ATOM_WEAK_TABLE";
+    case ATOM_STRING_BUILDER: return "ATOM_STRING_BUILDER";
     }
 
     return "";
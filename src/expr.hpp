@@ -3,18 +3,54 @@
 
 #pragma once
 
+#include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
-#include "gc.hpp"
-
 class Scope;
+struct Gc;
+struct JitCode;
 
 struct Cons;
 struct Atom;
 
+#ifdef COMPRESSED_REFS
+/*
+* Compressed references: every cons and atom lives in one reservation of
+    COMPRESSED_HEAP_SIZE bytes (see heap_map), so a reference is a 32-bit offset
+    from its base. An Expr takes 8 bytes instead of 16 and a cons 16 instead of 32.
+    Offset 0 is never handed out and stands for a null pointer.
+*/
+#define COMPRESSED_HEAP_SIZE (4UL << 30)
+
+extern char* compressed_heap_base;
+
+template <typename T>
+class CompressedRef
+{
+public:
+    CompressedRef() = default;
+    CompressedRef(T* pointer)
+        : offset(pointer == nullptr ? 0 : (uint32_t) (reinterpret_cast<char*>(pointer) - compressed_heap_base)) {}
+
+    operator T*() const
+    {
+        return offset == 0 ? nullptr : reinterpret_cast<T*>(compressed_heap_base + offset);
+    }
+
+    T* operator->() const { return *this; }
+    T& operator*() const { return *static_cast<T*>(*this); }
+
+private:
+    uint32_t offset;
+};
+#endif
+
 enum ExprType
 {
     EXPR_ATOM = 0,
@@ -35,8 +71,13 @@ struct Expr
     ExprType type;
     union
     {
+#ifdef COMPRESSED_REFS
+        CompressedRef<Cons> cons;
+        CompressedRef<Atom> atom;
+#else
         Cons* cons;
         Atom* atom;
+#endif
     };
 };
 
@@ -68,6 +109,8 @@ struct Native
 {
     NativeFunction fun;
     void* param;
+    bool pure;              // no side effects, result depends only on args
+    bool borrows_args;      // only reads its argument list during the call
 };
 
 struct Lambda
@@ -75,6 +118,12 @@ struct Lambda
     Expr args_list;
     Expr body;
     Expr envir;
+    Expr optimized;         // what call_lambda evaluates, see optimize_lambda
+    unsigned long int epoch;
+    long int calls;         // counts up to JIT_CALL_THRESHOLD
+    long int deopts;        // counts up to JIT_DEOPT_LIMIT
+    JitCode* jit;           // compiled optimized body or nullptr, see jit.cpp
+    bool frame_escapes;     // body may capture its call frame, see optimize_lambda
 };
 
 enum AtomType
@@ -84,11 +133,94 @@ enum AtomType
     ATOM_REAL,
     ATOM_STRING,
     ATOM_LAMBDA,
-    ATOM_NATIVE
+    ATOM_NATIVE,
+    ATOM_MACRO,
+    ATOM_WEAK_BOX,
+    ATOM_WEAK_TABLE,
+    ATOM_STRING_BUILDER
 };
 
 const std::string atom_type_as_string(AtomType atom_type);
 
+// Payloads of at least this many bytes go to the large-object space (see gc.cpp).
+#define LARGE_OBJECT_THRESHOLD (64 * 1024)
+
+void* large_object_allocate(size_t size);
+void large_object_free(void* payload, size_t size);
+
+/*
+* Allocator of string payloads. Small ones come from the general-purpose allocator,
+    large ones get mappings of their own that are never moved or copied by the collector.
+*/
+template <typename T>
+struct PayloadAllocator
+{
+    using value_type = T;
+
+    PayloadAllocator() = default;
+    template <typename U>
+    PayloadAllocator(const PayloadAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        if (n * sizeof(T) >= LARGE_OBJECT_THRESHOLD) {
+            return static_cast<T*>(large_object_allocate(n * sizeof(T)));
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (n * sizeof(T) >= LARGE_OBJECT_THRESHOLD) {
+            large_object_free(p, n * sizeof(T));
+            return;
+        }
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const PayloadAllocator<U>&) const { return true; }
+};
+
+using LispString = std::basic_string<char, std::char_traits<char>, PayloadAllocator<char>>;
+
+/*
+* An ephemeron table: each value is kept alive by the collector only as long as its key is,
+    and entries whose key died are dropped (see gc_collect).
+    Keys are compared by identity, the only notion of sameness that survives as long as the object.
+*/
+struct WeakTable
+{
+    std::unordered_map<const void*, std::pair<Expr, Expr>> entries;    // identity -> (key, value)
+};
+
+const void* expr_identity(const Expr& expr);
+
+// Strings at least this long are appended to a builder by reference instead of copied.
+#define ROPE_SHARE_THRESHOLD 256
+
+/*
+* A string under construction, kept as a rope: a sequence of pieces that are either
+    text the builder owns or whole string atoms it shares. Short appends go to the
+    owned text at the end, which grows geometrically; long strings are referenced,
+    not copied. The rope is flattened only when the string is asked for,
+    and then replaced by the result, so asking again costs nothing.
+*/
+struct RopePiece
+{
+    LispString text;
+    Expr shared;            // a string atom, or void for owned text
+};
+
+struct StringBuilder
+{
+    std::vector<RopePiece> pieces;
+    size_t length;
+};
+
+void string_builder_append(Gc* gc, StringBuilder* builder, Expr string);
+Expr string_builder_flatten(Gc* gc, Atom* builder);
+
 /*
 *  A structure for representing atomic values like symbols, 
     integers, real numbers, strings, lambda expressions, and native functions.
@@ -102,21 +234,42 @@ struct Atom
         long int num;           // ATOM_INTEGER
         float real;             // ATOM_REAL
         std::string sym;        // ATOM_SYMBOL
-        std::string str;        // ATOM_STRING
-        Lambda lambda;         // ATOM_LAMBDA
+        LispString str;         // ATOM_STRING
+        Lambda lambda;         // ATOM_LAMBDA, ATOM_MACRO
         Native native;         // ATOM_NATIVE
+        Expr weak;             // ATOM_WEAK_BOX, not followed by the collector
+        WeakTable* table;      // ATOM_WEAK_TABLE
+        StringBuilder* builder; // ATOM_STRING_BUILDER
     };
 };
 
 
+/*
+* nil and t are canonical: each is a single atom created once per process,
+    never registered with a Gc and therefore never swept.
+    create_symbol_atom hands them out for the names "nil" and "t",
+    so nil_p is a pointer comparison.
+*/
+extern Atom* const nil_atom;
+extern Atom* const t_atom;
+
+#define NIL(gc) atom_as_expr(nil_atom)
+#define T(gc) atom_as_expr(t_atom)
+
 Atom* create_real_atom(Gc* gc, float real);
 Atom* create_integer_atom(Gc* gc, long int num);
-Atom* create_string_atom(Gc* gc, const std::string& str, const std::string& str_end);
-Atom* create_symbol_atom(Gc* gc, const std::string& sym, const std::string& sym_end);
+Atom* create_string_atom(Gc* gc, const char* str, const char* str_end);
+Atom* create_symbol_atom(Gc* gc, const char* sym, const char* sym_end);
 Atom* create_lambda_atom(Gc* gc,Expr args_list, Expr body, Expr envir);
 Atom* create_native_atom(Gc* gc, NativeFunction fun, void* param);
+Atom* create_macro_atom(Gc* gc, Expr args_list, Expr body, Expr envir);
+Atom* create_weak_box_atom(Gc* gc, Expr value);
+Atom* create_weak_table_atom(Gc* gc);
+Atom* create_string_builder_atom(Gc* gc);
 
 void destroy_atom(Atom* atom);
+void finalize_atom(Atom* atom);
+bool atom_owns_memory(const Atom* atom);
 
 /*
 * A structure representing a cons cell,
@@ -134,6 +287,7 @@ struct Cons
 
 
 Cons* create_cons(Gc* gc, Expr car, Expr cdr);
+Expr list_from_array(Gc* gc, const Expr* items, size_t count, Expr tail);
 
 void destroy_cons(Cons* cons);
 void print_cons_as_sexpr(FILE* stream, Cons* head);
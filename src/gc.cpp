@@ -6,10 +6,17 @@
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <vector>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "builtins.hpp"
 #include "expr.hpp"
@@ -91,6 +98,7 @@ Gc *create_gc()
 
     gc->size = 0;
     gc->capacity = GC_INITIAL_CAPACITY;
+    gc->epoch = 1;
 
     return gc;
 
@@ -113,20 +121,106 @@ void destroy_gc(Gc *gc)
         destroy_expr(gc->exprs[i].get());
     }
 
+    if (gc->eval_stack != nullptr) {
+        munmap(gc->eval_stack, gc->eval_stack_size);
+    }
+
+    for (Atom *atom : gc->request.finalizers) {
+        finalize_atom(atom);
+    }
+
+    for (auto &chunks : gc->heap.chunks) {
+        for (ArenaChunk *chunk : chunks) {
+            heap_unmap(chunk, ARENA_CHUNK_SIZE);
+        }
+    }
+
+    for (Cons *chunk : gc->frames.chunks) {
+        heap_unmap(chunk, REGION_CHUNK_SIZE * sizeof(Cons));
+    }
+
+    for (char *block : gc->request.blocks) {
+        heap_unmap(block, REQUEST_BLOCK_SIZE);
+    }
+
     if (gc) {
         delete gc;
     }
 }
 
+// Bytes of a cons or atom, with the payloads it owns. Counted by gc_charge and gc_census.
+static size_t expr_bytes(const Expr &expr)
+{
+    if (expr.type == EXPR_CONS) {
+        return sizeof(Cons);
+    }
+
+    switch (expr.atom->type) {
+    case ATOM_SYMBOL:
+        return sizeof(Atom) + expr.atom->sym.capacity();
+    case ATOM_STRING:
+        return sizeof(Atom) + expr.atom->str.capacity();
+    case ATOM_STRING_BUILDER: {
+        size_t bytes = sizeof(Atom) + sizeof(StringBuilder);
+        for (const RopePiece &piece : expr.atom->builder->pieces) {
+            bytes += sizeof(RopePiece) + piece.text.capacity();
+        }
+        return bytes;
+    }
+    default:
+        return sizeof(Atom);
+    }
+}
+
+/*
+* Counts `bytes` against heap_limit and allocation_quota.
+    The allocation that crosses a limit throws MemoryExhausted, unless no form is running
+    (memory_checked is false) or the form already ran out: then there is nobody to unwind to,
+    or the form is being unwound and has to be able to build its error.
+*/
+void gc_charge(Gc *gc, size_t bytes)
+{
+    gc->heap_bytes += bytes;
+    gc->allocated += bytes;
+    if (gc->request.active) {
+        gc->request.bytes += bytes;
+    }
+
+    if (gc->memory_checked
+        && ((gc->heap_limit > 0 && gc->heap_bytes > gc->heap_limit)
+            || (gc->allocation_quota > 0 && gc->allocated > gc->allocation_quota))) {
+        gc->memory_checked = false;
+        throw MemoryExhausted {};
+    }
+}
+
 /*
 * Adds a new Expr to the garbage collector's tracking list.
     It ensures that there's adequate capacity in the GC's structures, resizing if necessary, 
     and then takes ownership of the expression using std::move to avoid unnecessary copying.
+
+    The expr is charged (see gc_charge) once it is tracked, so the heap stays consistent
+    when the charge throws.
 */
 int gc_add_expr(Gc *gc, Expr expr)
 {
     assert(gc);
 
+    const size_t bytes = expr_bytes(expr);
+
+    if (gc->request.active) {
+        if (expr.type == EXPR_ATOM && atom_owns_memory(expr.atom)) {
+            gc->request.finalizers.push_back(expr.atom);
+        }
+        gc_charge(gc, bytes);
+        return 0;
+    }
+
+    if (expr.type == EXPR_ATOM
+        && (expr.atom->type == ATOM_WEAK_BOX || expr.atom->type == ATOM_WEAK_TABLE)) {
+        gc->weak_atoms.push_back(expr.atom);
+    }
+
     if (gc->size >= gc->capacity) {
         const size_t new_capacity = gc->capacity * 2;
         std::vector<std::unique_ptr<Expr>> new_exprs(new_capacity);
@@ -142,6 +236,7 @@ int gc_add_expr(Gc *gc, Expr expr)
     }
 
     gc->exprs[gc->size++] = std::move(expr);
+    gc_charge(gc, bytes);
 
     return 0;
 }
@@ -236,39 +331,178 @@ static long int gc_find_expr(Gc *gc, const Expr& expr)
 
 
 // Performs a depth-first traversal of an expression tree.
-static void gc_traverse_expr(Gc *gc, const Expr& root)
+// The cdr of a cons is followed in a loop, so long lists don't deepen the C++ stack.
+static void gc_traverse_expr(Gc *gc, const Expr& start)
 {
     assert(gc);
-    assert(root->type != EXPR_VOID);
-    const long int root_index = gc_find_expr(gc, root);
-    if (root_index < 0) {
-        std::cerr << "GC tried to collect something that was not registered" << std::endl;
-        print_expr_as_sexpr(std::cerr, root);
-        std::cerr << std::endl;
-        assert(root_index >= 0);
-    }
 
-    if (gc->visited[root_index]) {
+    Expr root = start;
+
+    while (true) {
+        assert(root->type != EXPR_VOID);
+
+        // The canonical nil and t are not owned by any Gc.
+        if (root.type == EXPR_ATOM && (root.atom == nil_atom || root.atom == t_atom)) {
+            return;
+        }
+
+        const long int root_index = gc_find_expr(gc, root);
+        if (root_index < 0) {
+            std::cerr << "GC tried to collect something that was not registered" << std::endl;
+            print_expr_as_sexpr(std::cerr, root);
+            std::cerr << std::endl;
+            assert(root_index >= 0);
+        }
+
+        if (gc->visited[root_index]) {
+            return;
+        }
+
+        gc->visited[root_index] = true;
+
+        if (cons_p(root)) {
+            gc_traverse_expr(gc, root->cons->car);
+            root = root->cons->cdr;
+            continue;
+        }
+
+        if (root->type == EXPR_ATOM
+            && (root->atom->type == ATOM_LAMBDA || root->atom->type == ATOM_MACRO)) {
+            gc_traverse_expr(gc, root->atom->lambda.args_list);
+            gc_traverse_expr(gc, root->atom->lambda.body);
+            gc_traverse_expr(gc, root->atom->lambda.envir);
+            gc_traverse_expr(gc, root->atom->lambda.optimized);
+        }
+
+        if (root->type == EXPR_ATOM && root->atom->type == ATOM_STRING_BUILDER) {
+            for (const RopePiece &piece : root->atom->builder->pieces) {
+                if (piece.shared.type != EXPR_VOID) {
+                    gc_traverse_expr(gc, piece.shared);
+                }
+            }
+        }
+
         return;
     }
+}
+
+// Checks whether an expression was reached during the current mark phase.
+static bool gc_is_visited(Gc *gc, const Expr& expr)
+{
+    if (expr.type == EXPR_ATOM && (expr.atom == nil_atom || expr.atom == t_atom)) {
+        return true;
+    }
+
+    const long int index = gc_find_expr(gc, expr);
+    return index >= 0 && gc->visited[index];
+}
+
+/*
+* Marks what is only as alive as something else: cached macro expansions live as long as
+    the call site they were expanded from, values of a weak table as long as their key
+    (and the table). Marking one can reach the key of another, so this repeats until
+    nothing changes.
+*/
+static void gc_traverse_ephemerons(Gc *gc)
+{
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (const auto& [form, entry] : gc->macro_expansions) {
+            if (!gc_is_visited(gc, cons_as_expr(form))) {
+                continue;
+            }
+
+            const Expr macro = atom_as_expr(entry.macro);
+            if (!gc_is_visited(gc, macro) || !gc_is_visited(gc, entry.expansion)) {
+                gc_traverse_expr(gc, macro);
+                gc_traverse_expr(gc, entry.expansion);
+                changed = true;
+            }
+        }
+
+        for (Atom *atom : gc->weak_atoms) {
+            if (atom->type != ATOM_WEAK_TABLE || !gc_is_visited(gc, atom_as_expr(atom))) {
+                continue;
+            }
+
+            for (const auto& [identity, entry] : atom->table->entries) {
+                if (gc_is_visited(gc, entry.first) && !gc_is_visited(gc, entry.second)) {
+                    gc_traverse_expr(gc, entry.second);
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+/*
+* The weak phase, between the strong marking and the sweep.
+    1. Finalizers whose object was not reached move to pending_finalizers.
+    2. Weak boxes whose value was not reached are set to nil, weak table entries
+       whose key was not reached are dropped.
+    3. The callables of all finalizers are marked, with whatever they refer to.
+       An object a finalizer refers to survives this collection, but weak references
+       to it are already cleared and the finalizer runs only once.
+    4. Weak atoms that died are forgotten.
+*/
+static void gc_process_weak(Gc *gc)
+{
+    std::erase_if(gc->finalizers, [gc](const Finalizer &finalizer) {
+        if (gc_is_visited(gc, finalizer.object)) {
+            return false;
+        }
 
-    gc->visited[root_index] = true;
+        gc->pending_finalizers.push_back(finalizer.callable);
+        return true;
+    });
 
-    if (cons_p(root)) {
-        gc_traverse_expr(gc, root->cons->car);
-        gc_traverse_expr(gc, root->cons->cdr);
-    } else if (root->type == EXPR_ATOM
-               && root->atom->type == ATOM_LAMBDA) {
-        gc_traverse_expr(gc, root->atom->lambda.args_list);
-        gc_traverse_expr(gc, root->atom->lambda.body);
-        gc_traverse_expr(gc, root->atom->lambda.envir);
+    for (Atom *atom : gc->weak_atoms) {
+        if (atom->type == ATOM_WEAK_BOX) {
+            if (!gc_is_visited(gc, atom->weak)) {
+                atom->weak = NIL(gc);
+            }
+        } else {
+            std::erase_if(atom->table->entries, [gc](const auto &entry) {
+                return !gc_is_visited(gc, entry.second.first);
+            });
+        }
     }
+
+    for (const Finalizer &finalizer : gc->finalizers) {
+        gc_traverse_expr(gc, finalizer.callable);
+    }
+    for (const Expr &callable : gc->pending_finalizers) {
+        gc_traverse_expr(gc, callable);
+    }
+    gc_traverse_ephemerons(gc);
+
+    std::erase_if(gc->weak_atoms, [gc](Atom *atom) {
+        return !gc_is_visited(gc, atom_as_expr(atom));
+    });
+}
+
+void gc_add_finalizer(Gc *gc, Expr object, Expr callable)
+{
+    gc->finalizers.push_back(Finalizer {
+        gc_write_barrier(gc, nullptr, object),
+        gc_write_barrier(gc, nullptr, callable)
+    });
+}
+
+// Hands the finalizers that became due to the caller, which runs them (see eval_top_level).
+std::vector<Expr> gc_take_finalizers(Gc *gc)
+{
+    return std::exchange(gc->pending_finalizers, {});
 }
 
 // Performs garbage collection on the GC's list of expressions.
 void gc_collect(Gc *gc, const Expr& root)
 {
     assert(gc);
+    assert(!gc->request.active);
 
     // Sort gc->exprs O(nlogn)
     std::sort(gc->exprs.begin(), gc->exprs.begin() + gc->size,
@@ -276,18 +510,25 @@ void gc_collect(Gc *gc, const Expr& root)
                   return value_of_expr(*a) < value_of_expr(*b);
               });
 
-    // Defragment O(n)
-    gc->exprs.erase(std::remove_if(gc->exprs.begin(), gc->exprs.begin() + gc->size,
-                                   [](const std::unique_ptr<Expr>& expr) {
-                                       return expr->type == EXPR_VOID;
-                                   }), gc->exprs.end());
-    gc->size = gc->exprs.size();
-
     // Initialize visited array O(n)
     std::fill(gc->visited.begin(), gc->visited.begin() + gc->size, false);
 
     // Traverse root O(nlogn)
     gc_traverse_expr(gc, root);
+    gc_traverse_ephemerons(gc);
+    gc_process_weak(gc);
+
+    // Entries whose form was not reached are dropped before the sweep frees the form,
+    // otherwise a new form allocated at the same address would pick up a stale entry.
+    std::erase_if(gc->macro_expansions, [gc](const auto& entry) {
+        return !gc_is_visited(gc, cons_as_expr(entry.first));
+    });
+    std::erase_if(gc->case_tables, [gc](const auto& entry) {
+        return !gc_is_visited(gc, cons_as_expr(entry.first));
+    });
+
+    // Collection only happens between top-level forms, when no call holds region memory
+    gc->frames.top = 0;
 
     // Dealloc unvisited O(n)
     for (size_t i = 0; i < gc->size; ++i) {
@@ -296,6 +537,844 @@ void gc_collect(Gc *gc, const Expr& root)
             gc->exprs[i] = std::unique_ptr<Expr>(new Expr(EXPR_VOID));
         }
     }
+
+    // Give memory back: empty chunks, request blocks beyond the first, and the
+    // tracking list once it is mostly empty.
+    arena_trim(gc);
+
+    while (gc->request.blocks.size() > 1) {
+        heap_unmap(gc->request.blocks.back(), REQUEST_BLOCK_SIZE);
+        gc->request.blocks.pop_back();
+    }
+
+    // Defragment O(n)
+    gc->exprs.erase(std::remove_if(gc->exprs.begin(), gc->exprs.begin() + gc->size,
+                                   [](const std::unique_ptr<Expr>& expr) {
+                                       return expr->type == EXPR_VOID;
+                                   }), gc->exprs.begin() + gc->size);
+    gc->size = gc->exprs.size() - (gc->capacity - gc->size);
+
+    gc->heap_bytes = 0;
+    for (size_t i = 0; i < gc->size; ++i) {
+        gc->heap_bytes += expr_bytes(*gc->exprs[i]);
+    }
+
+    while (gc->capacity > GC_INITIAL_CAPACITY && gc->size < gc->capacity / 4) {
+        gc->capacity /= 2;
+    }
+
+    gc->exprs.resize(gc->capacity);
+    gc->exprs.shrink_to_fit();
+    gc->visited.resize(gc->capacity);
+    gc->visited.shrink_to_fit();
+}
+
+// ### Heap Memory.
+/*
+* heap_map hands out the memory every cons and atom is allocated from: arena chunks,
+    region chunks and request blocks. Blocks are at most ARENA_CHUNK_SIZE bytes and
+    aligned to it.
+
+* With COMPRESSED_REFS they are carved from a single reservation of COMPRESSED_HEAP_SIZE
+    bytes, which is what lets an Expr hold a 32-bit offset (see CompressedRef).
+    The reservation is made on first use and costs address space only; unmapped blocks
+    drop their pages and are reused. The first block is never handed out, so no object
+    sits at offset 0.
+*/
+
+#ifdef COMPRESSED_REFS
+char *compressed_heap_base;
+
+static struct {
+    size_t next;                    // offset of the first block never handed out
+    size_t end;                     // offset where the reservation ends
+    std::vector<char*> free_blocks;
+    std::mutex lock;
+} compressed_heap;
+
+void *heap_map(size_t size)
+{
+    assert(size <= ARENA_CHUNK_SIZE);
+    std::lock_guard<std::mutex> guard(compressed_heap.lock);
+
+    if (compressed_heap_base == nullptr) {
+        void *memory = mmap(nullptr, COMPRESSED_HEAP_SIZE, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        // Offsets are taken from an aligned base, so they keep the blocks aligned.
+        const uintptr_t start = reinterpret_cast<uintptr_t>(memory);
+        const uintptr_t aligned = (start + ARENA_CHUNK_SIZE - 1) & ~(uintptr_t) (ARENA_CHUNK_SIZE - 1);
+        compressed_heap_base = reinterpret_cast<char*>(aligned);
+        compressed_heap.next = ARENA_CHUNK_SIZE;
+        compressed_heap.end = COMPRESSED_HEAP_SIZE - (aligned - start);
+    }
+
+    char *block = nullptr;
+
+    if (!compressed_heap.free_blocks.empty()) {
+        block = compressed_heap.free_blocks.back();
+        compressed_heap.free_blocks.pop_back();
+    } else if (compressed_heap.next + ARENA_CHUNK_SIZE <= compressed_heap.end) {
+        block = compressed_heap_base + compressed_heap.next;
+        compressed_heap.next += ARENA_CHUNK_SIZE;
+    } else {
+        throw std::bad_alloc();
+    }
+
+    if (mprotect(block, ARENA_CHUNK_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        throw std::bad_alloc();
+    }
+
+    return block;
+}
+
+void heap_unmap(void *memory, size_t size)
+{
+    (void) size;
+    madvise(memory, ARENA_CHUNK_SIZE, MADV_DONTNEED);
+    mprotect(memory, ARENA_CHUNK_SIZE, PROT_NONE);
+
+    std::lock_guard<std::mutex> guard(compressed_heap.lock);
+    compressed_heap.free_blocks.push_back(static_cast<char*>(memory));
+}
+#else
+void *heap_map(size_t size)
+{
+    assert(size <= ARENA_CHUNK_SIZE);
+
+    // Over-allocate and cut, since mmap only guarantees page alignment.
+    const size_t length = 2 * ARENA_CHUNK_SIZE;
+    void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+
+    const uintptr_t start = reinterpret_cast<uintptr_t>(memory);
+    const uintptr_t aligned = (start + ARENA_CHUNK_SIZE - 1) & ~(uintptr_t) (ARENA_CHUNK_SIZE - 1);
+
+    if (aligned > start) {
+        munmap(memory, aligned - start);
+    }
+    munmap(reinterpret_cast<void*>(aligned + size), start + length - aligned - size);
+
+    return reinterpret_cast<void*>(aligned);
+}
+
+void heap_unmap(void *memory, size_t size)
+{
+    munmap(memory, size);
+}
+#endif
+
+// ### Heap Arena.
+/*
+* Objects of one size class are carved from a chunk by bumping `unused` and
+    recycled through the chunk's free list. arena_free needs no Gc: the chunk
+    header is found by masking the object's address.
+
+* After a sweep arena_trim unmaps chunks that became empty, keeping
+    ARENA_SPARE_CHUNKS per class mapped but with their pages dropped (MADV_DONTNEED),
+    so the next spike doesn't start with a round of mmap calls. With huge_pages set,
+    chunks that stayed at least three quarters full are offered to transparent
+    huge pages, which cuts TLB misses when marking a large live heap.
+*/
+
+static size_t arena_size_class(size_t size)
+{
+    const size_t size_class = (size + ARENA_GRANULE - 1) / ARENA_GRANULE - 1;
+    assert(size_class < ARENA_SIZE_CLASSES);
+    return size_class;
+}
+
+// The first object offset, leaving room for the header.
+static size_t arena_first_offset(size_t object_size)
+{
+    return (sizeof(ArenaChunk) + object_size - 1) / object_size * object_size;
+}
+
+static ArenaChunk *arena_map_chunk(size_t object_size)
+{
+    ArenaChunk *chunk = static_cast<ArenaChunk*>(heap_map(ARENA_CHUNK_SIZE));
+    chunk->object_size = object_size;
+    chunk->live = 0;
+    chunk->unused = arena_first_offset(object_size);
+    chunk->free_list = nullptr;
+    chunk->huge_pages = false;
+
+    return chunk;
+}
+
+static void *arena_chunk_allocate(ArenaChunk *chunk)
+{
+    void *object = chunk->free_list;
+
+    if (object != nullptr) {
+        chunk->free_list = *static_cast<void**>(object);
+    } else if (chunk->unused + chunk->object_size <= ARENA_CHUNK_SIZE) {
+        object = reinterpret_cast<char*>(chunk) + chunk->unused;
+        chunk->unused += chunk->object_size;
+    } else {
+        return nullptr;
+    }
+
+    chunk->live++;
+    return object;
+}
+
+void *arena_allocate(Gc *gc, size_t size)
+{
+    const size_t size_class = arena_size_class(size);
+    std::vector<ArenaChunk*> &chunks = gc->heap.chunks[size_class];
+    size_t &current = gc->heap.current[size_class];
+
+    for (; current < chunks.size(); ++current) {
+        void *object = arena_chunk_allocate(chunks[current]);
+        if (object != nullptr) {
+            return object;
+        }
+    }
+
+    chunks.push_back(arena_map_chunk((size_class + 1) * ARENA_GRANULE));
+    current = chunks.size() - 1;
+
+    return arena_chunk_allocate(chunks[current]);
+}
+
+/*
+* Carves a run of adjacent objects from the never allocated tail of a chunk,
+    as many as fit up to `count`. Freed slots are scattered, so they can't serve a run.
+    Runs need objects that fill their size class exactly, anything else gets one object.
+*/
+void *arena_allocate_run(Gc *gc, size_t size, size_t count, size_t *allocated)
+{
+    const size_t size_class = arena_size_class(size);
+
+    if (count <= 1 || size != (size_class + 1) * ARENA_GRANULE) {
+        *allocated = 1;
+        return arena_allocate(gc, size);
+    }
+
+    std::vector<ArenaChunk*> &chunks = gc->heap.chunks[size_class];
+    ArenaChunk *chunk = nullptr;
+
+    for (size_t i = gc->heap.current[size_class]; i < chunks.size(); ++i) {
+        if (chunks[i]->unused + size <= ARENA_CHUNK_SIZE) {
+            chunk = chunks[i];
+            break;
+        }
+    }
+
+    if (chunk == nullptr) {
+        chunks.push_back(arena_map_chunk(size));
+        chunk = chunks.back();
+    }
+
+    *allocated = std::min(count, (ARENA_CHUNK_SIZE - chunk->unused) / size);
+
+    void *objects = reinterpret_cast<char*>(chunk) + chunk->unused;
+    chunk->unused += *allocated * size;
+    chunk->live += *allocated;
+
+    return objects;
+}
+
+void arena_free(void *object)
+{
+    ArenaChunk *chunk = reinterpret_cast<ArenaChunk*>(
+        reinterpret_cast<uintptr_t>(object) & ~(uintptr_t) (ARENA_CHUNK_SIZE - 1));
+
+    assert(chunk->live > 0);
+    *static_cast<void**>(object) = chunk->free_list;
+    chunk->free_list = object;
+    chunk->live--;
+}
+
+void arena_trim(Gc *gc)
+{
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    for (size_t size_class = 0; size_class < ARENA_SIZE_CLASSES; ++size_class) {
+        std::vector<ArenaChunk*> &chunks = gc->heap.chunks[size_class];
+        size_t spare = 0;
+
+        std::erase_if(chunks, [&](ArenaChunk *chunk) {
+            if (chunk->live > 0) {
+                return false;
+            }
+
+            if (spare++ >= ARENA_SPARE_CHUNKS) {
+                heap_unmap(chunk, ARENA_CHUNK_SIZE);
+                return true;
+            }
+
+            // Keep the page holding the header, drop the rest.
+            const size_t object_size = chunk->object_size;
+            madvise(reinterpret_cast<char*>(chunk) + page, ARENA_CHUNK_SIZE - page, MADV_DONTNEED);
+            chunk->unused = arena_first_offset(object_size);
+            chunk->free_list = nullptr;
+            chunk->huge_pages = false;
+            return false;
+        });
+
+#ifdef MADV_HUGEPAGE
+        if (gc->heap.huge_pages) {
+            for (ArenaChunk *chunk : chunks) {
+                const size_t capacity = (ARENA_CHUNK_SIZE - arena_first_offset(chunk->object_size))
+                                        / chunk->object_size;
+                if (!chunk->huge_pages && chunk->live >= capacity / 4 * 3) {
+                    madvise(chunk, ARENA_CHUNK_SIZE, MADV_HUGEPAGE);
+                    chunk->huge_pages = true;
+                }
+            }
+        }
+#endif
+
+        // Fill the fullest chunks first: sparse ones are the next to become empty.
+        std::sort(chunks.begin(), chunks.end(), [](const ArenaChunk *a, const ArenaChunk *b) {
+            return a->live > b->live;
+        });
+        gc->heap.current[size_class] = 0;
+    }
+}
+
+/*
+* Region allocation is a bump of `top`; releasing pops everything allocated since `mark`.
+    Chunks are kept once allocated, so deep recursion pays for them only once.
+*/
+Cons *region_cons(Gc *gc, Expr car, Expr cdr)
+{
+    Region &region = gc->frames;
+    const size_t chunk = region.top / REGION_CHUNK_SIZE;
+
+    if (chunk == region.chunks.size()) {
+        region.chunks.push_back(static_cast<Cons*>(heap_map(REGION_CHUNK_SIZE * sizeof(Cons))));
+    }
+
+    Cons *cons = &region.chunks[chunk][region.top % REGION_CHUNK_SIZE];
+    cons->car = car;
+    cons->cdr = cdr;
+    region.top++;
+
+    return cons;
+}
+
+size_t region_mark(const Gc *gc)
+{
+    return gc->frames.top;
+}
+
+void region_release(Gc *gc, size_t mark)
+{
+    assert(mark <= gc->frames.top);
+    gc->frames.top = mark;
+}
+
+bool region_owns(const Gc *gc, const Cons *cons)
+{
+    const std::less<const Cons*> less;
+
+    for (const Cons *chunk : gc->frames.chunks) {
+        if (!less(cons, chunk) && less(cons, chunk + REGION_CHUNK_SIZE)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Copies every region cons reachable from `expr` to the heap, so it can outlive the region.
+Expr region_evacuate(Gc *gc, Expr expr)
+{
+    if (!cons_p(expr) || !region_owns(gc, expr.cons)) {
+        return expr;
+    }
+
+    return CONS(gc,
+                region_evacuate(gc, expr.cons->car),
+                region_evacuate(gc, expr.cons->cdr));
+}
+
+// ### Large-Object Space.
+/*
+* String payloads of LARGE_OBJECT_THRESHOLD bytes or more are mapped one by one
+    and linked into a list through a header in front of the payload. They are
+    never moved or copied: the collector only ever sees the small atom that owns one,
+    and freeing it returns the whole mapping to the OS at once.
+    Payloads are allocated by std::string's allocator, which has no Gc at hand,
+    so the list is process-wide.
+*/
+
+struct LargeObject {
+    LargeObject *prev;
+    LargeObject *next;
+    size_t length;          // of the mapping
+};
+
+// Keeps the payload 16-byte aligned.
+#define LARGE_OBJECT_HEADER ((sizeof(LargeObject) + 15) & ~(size_t) 15)
+
+static struct {
+    std::mutex lock;
+    LargeObject list = { &list, &list, 0 };
+    size_t count;
+    size_t bytes;
+} large_objects;
+
+void *large_object_allocate(size_t size)
+{
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t length = (LARGE_OBJECT_HEADER + size + page - 1) / page * page;
+
+    void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+
+    LargeObject *object = static_cast<LargeObject*>(memory);
+    object->length = length;
+
+    std::lock_guard<std::mutex> guard(large_objects.lock);
+    object->prev = &large_objects.list;
+    object->next = large_objects.list.next;
+    object->next->prev = object;
+    large_objects.list.next = object;
+    large_objects.count++;
+    large_objects.bytes += length;
+
+    return static_cast<char*>(memory) + LARGE_OBJECT_HEADER;
+}
+
+void large_object_free(void *payload, size_t size)
+{
+    (void) size;
+    LargeObject *object = reinterpret_cast<LargeObject*>(static_cast<char*>(payload) - LARGE_OBJECT_HEADER);
+
+    {
+        std::lock_guard<std::mutex> guard(large_objects.lock);
+        object->prev->next = object->next;
+        object->next->prev = object->prev;
+        large_objects.count--;
+        large_objects.bytes -= object->length;
+    }
+
+    munmap(object, object->length);
+}
+
+// ### Request Regions.
+/*
+* Problem: a server evaluates each request against a long-lived global environment.
+    Nearly everything a request allocates is garbage when it ends, yet it is all
+    registered in `exprs` and waits for a full gc_collect.
+
+* Solution: between gc_begin_request and gc_end_request, gc_new allocates from
+    a bump region that the collector never sees. The heap must never point into
+    the region, so every place that stores into an object older than the request
+    goes through gc_write_barrier, which evacuates the stored value to the heap:
+    - binding cells and the global frame (set_scope_value),
+    - re-optimized bodies of existing lambdas (call_lambda),
+    - cached expansions of existing call sites (expand_macro).
+    The original stays in the region and the request may still hold it, so the
+    natives of mutable objects (string builders, weak tables) redirect to the copy
+    (gc_forwarded), or writes through the original would not reach what is kept.
+    gc_end_request evacuates the result, drops cache entries keyed by region
+    objects and resets the region: freeing it costs one destructor per string,
+    symbol and lambda the request made, nothing for conses and numbers.
+*/
+
+void gc_begin_request(Gc *gc)
+{
+    assert(!gc->request.active);
+    gc->request.active = true;
+}
+
+Expr gc_end_request(Gc *gc, Expr result)
+{
+    assert(gc->request.active);
+
+    gc->request.ending = true;
+    Expr kept = gc_request_evacuate(gc, result);
+    gc->request.ending = false;
+
+    std::erase_if(gc->macro_expansions, [gc](const auto& entry) {
+        return gc_request_owns(gc, entry.first) || gc_request_owns(gc, entry.second.macro);
+    });
+    std::erase_if(gc->case_tables, [gc](const auto& entry) {
+        return gc_request_owns(gc, entry.first);
+    });
+
+    for (Atom *atom : gc->request.finalizers) {
+        finalize_atom(atom);
+    }
+
+    gc->request.finalizers.clear();
+    gc->request.forwarded.clear();
+    gc->heap_bytes -= gc->request.bytes;
+    gc->request.bytes = 0;
+    gc->request.block = 0;
+    gc->request.offset = 0;
+    gc->request.active = false;
+
+    return kept;
+}
+
+void *gc_request_allocate(Gc *gc, size_t size, size_t align)
+{
+    RequestRegion &region = gc->request;
+    const size_t offset = (region.offset + align - 1) & ~(align - 1);
+
+    if (region.block < region.blocks.size() && offset + size <= REQUEST_BLOCK_SIZE) {
+        region.offset = offset + size;
+        return region.blocks[region.block] + offset;
+    }
+
+    if (region.block < region.blocks.size()) {
+        region.block++;
+    }
+
+    if (region.block == region.blocks.size()) {
+        region.blocks.push_back(static_cast<char*>(heap_map(REQUEST_BLOCK_SIZE)));
+    }
+
+    region.offset = size;
+    return region.blocks[region.block];
+}
+
+static bool request_contains(const RequestRegion &region, const void *object)
+{
+    const std::less<const char*> less;
+    const char *p = static_cast<const char*>(object);
+
+    for (size_t i = 0; i < region.blocks.size() && i <= region.block; ++i) {
+        const char *block = region.blocks[i];
+        if (!less(p, block) && less(p, block + REQUEST_BLOCK_SIZE)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool gc_request_owns(const Gc *gc, const void *object)
+{
+    return gc->request.active && request_contains(gc->request, object);
+}
+
+static Expr request_evacuate(Gc *gc, Expr expr, Forwarding &forwarded);
+
+static Expr request_evacuate_atom(Gc *gc, Atom *atom, Forwarding &forwarded)
+{
+    Atom *copy = NULL;
+
+    switch (atom->type) {
+    case ATOM_INTEGER:
+        copy = create_integer_atom(gc, atom->num);
+        break;
+
+    case ATOM_REAL:
+        copy = create_real_atom(gc, atom->real);
+        break;
+
+    case ATOM_STRING:
+        // At the end of the request the original dies and its payload moves along,
+        // which keeps large ones in place. A write barrier copies it, as the request
+        // may still use the original.
+        if (gc->request.ending) {
+            copy = create_string_atom(gc, "", NULL);
+            copy->str.swap(atom->str);
+            gc_charge(gc, copy->str.capacity());
+        } else {
+            copy = create_string_atom(gc, atom->str.data(), atom->str.data() + atom->str.size());
+        }
+        break;
+
+    case ATOM_SYMBOL:
+        copy = create_symbol_atom(gc, atom->sym.data(), atom->sym.data() + atom->sym.size());
+        break;
+
+    case ATOM_NATIVE:
+        copy = create_native_atom(gc, atom->native.fun, atom->native.param);
+        copy->native = atom->native;
+        break;
+
+    case ATOM_LAMBDA:
+    case ATOM_MACRO:
+        // A closure can reach itself through its environment: forward first, then fill in.
+        copy = create_lambda_atom(gc, NIL(gc), NIL(gc), NIL(gc));
+        copy->type = atom->type;
+        forwarded[atom] = atom_as_expr(copy);
+
+        copy->lambda.args_list = request_evacuate(gc, atom->lambda.args_list, forwarded);
+        copy->lambda.body = request_evacuate(gc, atom->lambda.body, forwarded);
+        copy->lambda.envir = request_evacuate(gc, atom->lambda.envir, forwarded);
+        copy->lambda.optimized = request_evacuate(gc, atom->lambda.optimized, forwarded);
+        copy->lambda.epoch = atom->lambda.epoch;
+        copy->lambda.calls = atom->lambda.calls;
+        copy->lambda.deopts = atom->lambda.deopts;
+        copy->lambda.frame_escapes = atom->lambda.frame_escapes;
+        copy->lambda.jit = atom->lambda.jit;
+        atom->lambda.jit = nullptr;
+        break;
+
+    case ATOM_WEAK_BOX:
+        copy = create_weak_box_atom(gc, NIL(gc));
+        forwarded[atom] = atom_as_expr(copy);
+        copy->weak = request_evacuate(gc, atom->weak, forwarded);
+        break;
+
+    case ATOM_WEAK_TABLE:
+        copy = create_weak_table_atom(gc);
+        forwarded[atom] = atom_as_expr(copy);
+
+        for (const auto &[identity, entry] : atom->table->entries) {
+            const Expr key = request_evacuate(gc, entry.first, forwarded);
+            copy->table->entries[expr_identity(key)] =
+                std::make_pair(key, request_evacuate(gc, entry.second, forwarded));
+        }
+        break;
+
+    case ATOM_STRING_BUILDER:
+        copy = create_string_builder_atom(gc);
+        forwarded[atom] = atom_as_expr(copy);
+        if (gc->request.ending) {
+            std::swap(*copy->builder, *atom->builder);
+        } else {
+            *copy->builder = *atom->builder;
+        }
+
+        for (RopePiece &piece : copy->builder->pieces) {
+            piece.shared = request_evacuate(gc, piece.shared, forwarded);
+            gc_charge(gc, sizeof(RopePiece) + piece.text.capacity());
+        }
+        break;
+    }
+
+    forwarded[atom] = atom_as_expr(copy);
+    return atom_as_expr(copy);
+}
+
+// Copies the region objects reachable from `expr` to the heap, preserving sharing and cycles.
+// Lists are copied along the cdr in a loop, only the cars recurse.
+static Expr request_evacuate(Gc *gc, Expr expr, Forwarding &forwarded)
+{
+    Expr head = void_expr();
+    Cons *last = NULL;
+
+    while (true) {
+        Expr copy = expr;
+        const void *object = expr_identity(expr);
+
+        if (expr.type != EXPR_VOID && request_contains(gc->request, object)) {
+            auto it = forwarded.find(object);
+
+            if (it != forwarded.end()) {
+                copy = it->second;
+            } else if (expr.type == EXPR_ATOM) {
+                copy = request_evacuate_atom(gc, expr.atom, forwarded);
+            } else {
+                Cons *cons = create_cons(gc, NIL(gc), NIL(gc));
+                forwarded[object] = cons_as_expr(cons);
+                cons->car = request_evacuate(gc, expr.cons->car, forwarded);
+
+                if (last == NULL) {
+                    head = cons_as_expr(cons);
+                } else {
+                    last->cdr = cons_as_expr(cons);
+                }
+
+                last = cons;
+                expr = expr.cons->cdr;
+                continue;
+            }
+        }
+
+        if (last == NULL) {
+            return copy;
+        }
+
+        last->cdr = copy;
+        return head;
+    }
+}
+
+Expr gc_request_evacuate(Gc *gc, Expr expr)
+{
+    if (!gc->request.active) {
+        return expr;
+    }
+
+    // The copies go to the heap. They are charged, but may not throw halfway through:
+    // a later allocation of the form does. The forwarding map is kept for the whole
+    // request, so an object reached by several barriers and by gc_end_request has one copy.
+    gc->request.active = false;
+    const bool memory_checked = std::exchange(gc->memory_checked, false);
+    Expr copy = request_evacuate(gc, expr, gc->request.forwarded);
+    gc->memory_checked = memory_checked;
+    gc->request.active = true;
+
+    return copy;
+}
+
+Expr gc_write_barrier(Gc *gc, const void *holder, Expr value)
+{
+    if (!gc->request.active || request_contains(gc->request, holder)) {
+        return value;
+    }
+
+    return gc_request_evacuate(gc, value);
+}
+
+/*
+* The heap copy a write barrier made of a request region object, or the object itself.
+    Natives that mutate an object, or read its mutable state, go through the copy:
+    it is what gc_end_request keeps, and it may also be reached from the heap.
+*/
+Expr gc_forwarded(const Gc *gc, Expr expr)
+{
+    if (!gc->request.active || gc->request.forwarded.empty()) {
+        return expr;
+    }
+
+    auto copy = gc->request.forwarded.find(expr_identity(expr));
+    return copy == gc->request.forwarded.end() ? expr : copy->second;
+}
+
+// ### Heap Census and Dump.
+/*
+* Both look at every registered expr, so objects that died since the last
+    collection are included. The repl collects before every form, which leaves
+    little more than what the current form allocated.
+    Objects in the request region and in the call frame region are not registered
+    and are left out; neither function moves anything out of a region, so looking
+    does not change what is measured. The dump only walks the scope to find the
+    global frame.
+    The dump is plain text, one record per line, read by tools/heap-summary.cpp:
+
+        lisp-heap 1
+        o <id> <kind> <bytes> [<text>]      an object; <text> for symbols, strings, numbers
+        e <from> <to>                        a reference
+        r <id> <name>                        a global binding, the start of retainer paths
+
+    Ids are object addresses in hex. References to nil and t are left out.
+*/
+
+static const char *const heap_kind_names[HEAP_KINDS] = {
+    "cons", "symbol", "integer", "real", "string", "lambda", "native", "macro",
+    "weak-box", "weak-table", "string-builder"
+};
+
+const char *heap_kind_name(size_t kind)
+{
+    assert(kind < HEAP_KINDS);
+    return heap_kind_names[kind];
+}
+
+static size_t heap_kind(const Expr &expr)
+{
+    return expr.type == EXPR_CONS ? 0 : 1 + expr.atom->type;
+}
+
+HeapCensus gc_census(const Gc *gc)
+{
+    HeapCensus census = {};
+
+    for (size_t i = 0; i < gc->size; ++i) {
+        const Expr &expr = *gc->exprs[i];
+        if (expr.type == EXPR_VOID) {
+            continue;
+        }
+
+        census.counts[heap_kind(expr)]++;
+        census.bytes[heap_kind(expr)] += expr_bytes(expr);
+    }
+
+    std::lock_guard<std::mutex> guard(large_objects.lock);
+    census.large_objects = large_objects.count;
+    census.large_bytes = large_objects.bytes;
+
+    return census;
+}
+
+static void gc_dump_edge(const Expr &from, const Expr &to, std::ostream &out)
+{
+    if (to.type == EXPR_VOID || (to.type == EXPR_ATOM && (to.atom == nil_atom || to.atom == t_atom))) {
+        return;
+    }
+
+    out << "e " << expr_identity(from) << ' ' << expr_identity(to) << '\n';
+}
+
+// Text is cut at the first line break and at 40 bytes, which is plenty to recognise a leak.
+static void gc_dump_text(std::string_view text, std::ostream &out)
+{
+    const size_t end = std::min(text.find('\n'), (size_t) 40);
+    out << ' ' << text.substr(0, end);
+}
+
+void gc_dump(const Gc *gc, const Expr &root, std::ostream &out)
+{
+    out << "lisp-heap 1\n";
+
+    for (size_t i = 0; i < gc->size; ++i) {
+        const Expr &expr = *gc->exprs[i];
+        if (expr.type == EXPR_VOID) {
+            continue;
+        }
+
+        out << "o " << expr_identity(expr) << ' ' << heap_kind_names[heap_kind(expr)]
+            << ' ' << expr_bytes(expr);
+
+        if (expr.type == EXPR_CONS) {
+            out << '\n';
+            gc_dump_edge(expr, expr.cons->car, out);
+            gc_dump_edge(expr, expr.cons->cdr, out);
+            continue;
+        }
+
+        const Atom *atom = expr.atom;
+        switch (atom->type) {
+        case ATOM_SYMBOL:  gc_dump_text(atom->sym, out); break;
+        case ATOM_STRING:  gc_dump_text(atom->str, out); break;
+        case ATOM_INTEGER: out << ' ' << atom->num; break;
+        case ATOM_REAL:    out << ' ' << atom->real; break;
+        default: break;
+        }
+        out << '\n';
+
+        if (atom->type == ATOM_STRING_BUILDER) {
+            for (const RopePiece &piece : atom->builder->pieces) {
+                gc_dump_edge(expr, piece.shared, out);
+            }
+        }
+
+        if (atom->type == ATOM_LAMBDA || atom->type == ATOM_MACRO) {
+            gc_dump_edge(expr, atom->lambda.args_list, out);
+            gc_dump_edge(expr, atom->lambda.body, out);
+            gc_dump_edge(expr, atom->lambda.envir, out);
+            gc_dump_edge(expr, atom->lambda.optimized, out);
+        }
+    }
+
+    // The global frame is the last one of the scope.
+    Expr frames = root;
+    while (cons_p(frames) && cons_p(frames.cons->cdr)) {
+        frames = frames.cons->cdr;
+    }
+
+    if (!cons_p(frames)) {
+        return;
+    }
+
+    for (Expr bindings = frames.cons->car; cons_p(bindings); bindings = bindings.cons->cdr) {
+        const Expr binding = bindings.cons->car;
+        if (cons_p(binding) && symbol_p(binding.cons->car)) {
+            out << "r " << expr_identity(binding) << ' ' << binding.cons->car.atom->sym << '\n';
+        }
+    }
 }
 
 // Prints a visual representation of the GC's list of expressions. 
@@ -3,13 +3,211 @@
 
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 #include "expr.hpp"
 
+/*
+* The expansion of one macro call site. It stays valid for as long as the
+    head of the call site still evaluates to `macro`; redefining the macro
+    binds a new atom, which makes the entry stale.
+*/
+struct MacroExpansion {
+    Atom* macro;
+    Expr expansion;
+};
+
+/*
+* Dispatch table of one `case` form, built the first time the form is evaluated.
+    Clause bodies are parts of the form itself, so they live exactly as long as the form.
+*/
+struct CaseTable {
+    std::unordered_map<long int, Expr> integers;
+    std::unordered_map<std::string, Expr> symbols;
+    std::vector<std::pair<Expr, Expr>> others;  // other keys, compared with equal in order
+    Expr otherwise;
+    bool has_otherwise;
+};
+
+/*
+* A callable to run once `object` has become unreachable, registered with `finalize`.
+    `object` itself is not kept alive by the entry.
+*/
+struct Finalizer {
+    Expr object;
+    Expr callable;
+};
+
+/*
+* The parts of the last error raised by wrong_argument_type or wrong_integer_of_arguments.
+    The error list itself is only built by error_object, when someone looks at it.
+*/
+struct PendingError {
+    const char* name;       // head symbol of the error
+    std::string type;       // wrong-argument-type: the predicate that failed
+    Expr obj;               // wrong-argument-type: the offending object
+    long int count;         // wrong-integer-of-arguments: the number of arguments
+};
+
+/*
+* Thrown by gc_charge when an allocation crosses heap_limit or allocation_quota.
+    It unwinds to eval_top_level like LispThrow unwinds to `catch`, so a native that
+    allocates in a loop of its own stops at the limit too, and the allocation that
+    crossed it never returns to code that would go on.
+*/
+struct MemoryExhausted {};
+
+// Default limit of nested eval_funcall calls, beyond which eval raises stack-overflow.
+#define EVAL_DEPTH_LIMIT 1000000
+// Stack reserved for eval_top_level per allowed level of nesting.
+#define EVAL_STACK_BYTES_PER_LEVEL 4096
+// Thread stack assumed when its limit is unknown, see thread_stack_depth.
+#define THREAD_STACK_BYTES 8388608
+
+// Steps between two looks at the clock when a time limit is set.
+#define EVAL_CHECK_INTERVAL 4096
+
+// Conses per chunk of a Region.
+#define REGION_CHUNK_SIZE 4096
+
+/*
+* A stack of conses for data that dies when the call that allocated it returns:
+    frames of lambdas whose body can't capture them and argument lists of callees
+    that only read them (see apply_lambda and eval_funcall).
+    Region conses are never registered in `exprs`, so they cost the collector nothing.
+*/
+struct Region {
+    std::vector<Cons*> chunks;      // from heap_map
+    size_t top;
+};
+
+// Bytes per heap chunk, also its alignment. One huge page on x86-64.
+#define ARENA_CHUNK_SIZE (2 << 20)
+// Heap objects are grouped by size, in steps of ARENA_GRANULE bytes.
+#define ARENA_GRANULE 16
+#define ARENA_SIZE_CLASSES 8
+// Empty chunks per size class kept mapped (with their pages dropped) after a collection.
+#define ARENA_SPARE_CHUNKS 1
+
+/*
+* Header at the start of every heap chunk. Chunks are aligned to their size,
+    so an object finds its chunk by masking its address (see arena_free).
+*/
+struct ArenaChunk {
+    size_t object_size;
+    size_t live;            // objects allocated and not freed
+    size_t unused;          // offset of the never allocated tail
+    void* free_list;        // freed objects, linked through their first word
+    bool huge_pages;
+};
+
+/*
+* The heap: conses and atoms live in mmap'd chunks, one size class per chunk.
+    Emptied chunks go back to the OS after a collection (see arena_trim),
+    so the process shrinks again after a load spike.
+*/
+struct Arena {
+    std::vector<ArenaChunk*> chunks[ARENA_SIZE_CLASSES];
+    size_t current[ARENA_SIZE_CLASSES];   // chunk the next allocation tries first
+    bool huge_pages;                      // ask for transparent huge pages on dense chunks
+};
+
+// Bytes per block of the request region.
+#define REQUEST_BLOCK_SIZE (1 << 20)
+
+/*
+* Bump allocator for everything one request allocates (see gc_begin_request).
+    Nothing in it is registered with the collector; at the end of the request
+    whatever the global environment kept has been evacuated to the heap,
+    and the blocks are reused as they are.
+*/
+// Region object -> its copy on the heap.
+using Forwarding = std::unordered_map<const void*, Expr>;
+
+struct RequestRegion {
+    std::vector<char*> blocks;      // from heap_map
+    size_t block;                   // block being filled
+    size_t offset;                  // bytes used in it
+    std::vector<Atom*> finalizers;  // region atoms owning memory of their own
+    Forwarding forwarded;           // every copy made so far, so an object is copied once
+    size_t bytes;                   // charged while active, given back by gc_end_request
+    bool active;
+    bool ending;                    // gc_end_request is evacuating, the originals die next
+};
+
 struct Gc {
     std::vector<std::unique_ptr<Expr>> exprs;
     std::vector<bool> visited;
     size_t size;
     size_t capacity;
+
+    Arena heap;
+
+    // Keyed by the call site form. Entries die together with their form.
+    std::unordered_map<Cons*, MacroExpansion> macro_expansions;
+
+    // Keyed by the arguments of the `case` form. Entries die together with their form.
+    std::unordered_map<Cons*, CaseTable> case_tables;
+
+    // Weak boxes and weak tables on the heap, cleared by the weak phase of gc_collect.
+    std::vector<Atom*> weak_atoms;
+    std::vector<Finalizer> finalizers;
+    std::vector<Expr> pending_finalizers;   // callables whose object died, see gc_take_finalizers
+
+    // Bumped whenever a global function or constant is rebound.
+    // Optimized lambda bodies are only valid for the epoch they were made in.
+    unsigned long int epoch;
+    std::unordered_set<std::string> constants;
+
+    Region frames;
+
+    // Tags of the active `catch` forms, innermost last.
+    std::vector<Expr> catch_tags;
+
+    // Valid from the failure that carries a void expr until the next such failure.
+    PendingError pending_error;
+
+    // Nesting of eval_funcall; deeper than max_eval_depth is a stack-overflow error.
+    size_t eval_depth;
+    size_t max_eval_depth = EVAL_DEPTH_LIMIT;
+
+    // The stack eval_top_level runs on. Reserved on first use;
+    // the OS only commits the pages recursion actually touches.
+    void* eval_stack;
+    size_t eval_stack_size;
+
+    // Budget of each top-level evaluation, 0 is unlimited. See eval_step.
+    unsigned long int step_limit;
+    unsigned long int time_limit_ms;
+
+    unsigned long int steps_used;
+    long int steps_until_check;
+    long int steps_in_slice;
+    std::chrono::steady_clock::time_point deadline;
+    const char* budget_exhausted;   // the error symbol once the budget ran out
+
+    // Memory limits in bytes, 0 is unlimited: the heap (conses and atoms with their
+    // string payloads, live or not yet swept) and what one top-level evaluation allocates.
+    // heap_bytes is only recounted by gc_collect, between forms, so within a form heap_limit
+    // also counts the form's garbage: it caps the live heap left by earlier forms plus
+    // everything this form allocates, an allocation_quota that shrinks as the heap grows.
+    size_t heap_limit;
+    size_t allocation_quota;
+    size_t allocated;
+    size_t heap_bytes;              // exact after gc_collect, grows with every gc_charge
+    bool memory_checked;            // while a form runs, see gc_charge
+
+    RequestRegion request;
+    bool request_per_form;          // every top-level form is a request, see eval_top_level
 };
 
 
@@ -17,8 +215,79 @@ Gc* create_gc();
 void destroy_gc(Gc* gc);
 
 int gc_add_expr(Gc* gc, Expr expr);
+void gc_charge(Gc* gc, size_t bytes);
 
 void gc_collect(Gc* gc, const Expr& root);
+void gc_add_finalizer(Gc* gc, Expr object, Expr callable);
+std::vector<Expr> gc_take_finalizers(Gc* gc);
+
+Cons* region_cons(Gc* gc, Expr car, Expr cdr);
+size_t region_mark(const Gc* gc);
+void region_release(Gc* gc, size_t mark);
+bool region_owns(const Gc* gc, const Cons* cons);
+Expr region_evacuate(Gc* gc, Expr expr);
+
+void* heap_map(size_t size);
+void heap_unmap(void* memory, size_t size);
+
+void* arena_allocate(Gc* gc, size_t size);
+void* arena_allocate_run(Gc* gc, size_t size, size_t count, size_t* allocated);
+void arena_free(void* object);
+void arena_trim(Gc* gc);
+
+void gc_begin_request(Gc* gc);
+Expr gc_end_request(Gc* gc, Expr result);
+void* gc_request_allocate(Gc* gc, size_t size, size_t align);
+bool gc_request_owns(const Gc* gc, const void* object);
+Expr gc_request_evacuate(Gc* gc, Expr expr);
+Expr gc_write_barrier(Gc* gc, const void* holder, Expr value);
+Expr gc_forwarded(const Gc* gc, Expr expr);
+
+// Allocates a cons or an atom: in the request region during a request, on the heap otherwise.
+template <typename T>
+T* gc_new(Gc* gc)
+{
+    if (gc->request.active) {
+        return new (gc_request_allocate(gc, sizeof(T), alignof(T))) T;
+    }
+
+    return new (arena_allocate(gc, sizeof(T))) T;
+}
+
+// Allocates between 1 and `count` adjacent conses or atoms; `*allocated` tells how many.
+template <typename T>
+T* gc_new_run(Gc* gc, size_t count, size_t* allocated)
+{
+    T* objects;
+
+    if (gc->request.active) {
+        *allocated = std::min(count, (size_t) REQUEST_BLOCK_SIZE / sizeof(T));
+        objects = static_cast<T*>(gc_request_allocate(gc, *allocated * sizeof(T), alignof(T)));
+    } else {
+        objects = static_cast<T*>(arena_allocate_run(gc, sizeof(T), count, allocated));
+    }
+
+    for (size_t i = 0; i < *allocated; ++i) {
+        new (&objects[i]) T;
+    }
+
+    return objects;
+}
+
 void gc_inspect(const Gc* gc);
 
+// Kinds of heap objects counted by gc_census: conses, then one per AtomType.
+#define HEAP_KINDS (1 + ATOM_STRING_BUILDER + 1)
+
+struct HeapCensus {
+    size_t counts[HEAP_KINDS];
+    size_t bytes[HEAP_KINDS];       // object plus the text of strings and symbols
+    size_t large_objects;           // mappings of the large-object space, of all Gcs
+    size_t large_bytes;
+};
+
+const char* heap_kind_name(size_t kind);
+HeapCensus gc_census(const Gc* gc);
+void gc_dump(const Gc* gc, const Expr& root, std::ostream& out);
+
 #endif  // GC_H_
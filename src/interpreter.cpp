@@ -3,12 +3,21 @@
 #pragma once
 
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include <cstdarg>
 #include <cstdbool>
+#include <climits>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <ucontext.h>
+#include <unistd.h>
 
 #include "interpreter.hpp"
+#include "jit.hpp"
 
 /*
 * Problem: Evaluation of expressions.
@@ -73,20 +82,60 @@ EvalResult eval_failure(Expr error)
     return result;
 }
 
-// Returns an evaluation failure due to receiving an argument of the wrong type.
+/*
+* Returns an evaluation failure due to receiving an argument of the wrong type.
+* Validation errors are frequent and mostly only tested, so the error list is not
+    built here: the failure carries a void expr and the parts go to gc->pending_error.
+*/
 EvalResult wrong_argument_type(Gc* gc, const std::string& type, Expr obj)
 {
-    return eval_failure(
-        list(gc, "qqe", "wrong-argument-type", type, obj));
+    gc->pending_error.name = "wrong-argument-type";
+    gc->pending_error.type = type;
+    gc->pending_error.obj = obj;
+
+    return eval_failure(void_expr());
 }
 
-// Returns an evaluation failure due to receiving an incorrect number of arguments. 
+// Returns an evaluation failure due to receiving an incorrect number of arguments, see above.
 EvalResult wrong_integer_of_arguments(Gc* gc, long int count)
 {
-    return eval_failure(
-        CONS(gc,
-            SYMBOL(gc, "wrong-integer-of-arguments"),
-            INTEGER(gc, count)));
+    gc->pending_error.name = "wrong-integer-of-arguments";
+    gc->pending_error.count = count;
+
+    return eval_failure(void_expr());
+}
+
+/*
+* The error object of a failure, building it if the failure is pending (see wrong_argument_type).
+* Must be called before anything else can fail, which replaces the pending error.
+*/
+Expr error_object(Gc* gc, EvalResult error)
+{
+    assert(error.is_error);
+
+    if (error.expr.type != EXPR_VOID) {
+        return error.expr;
+    }
+
+    const PendingError& pending = gc->pending_error;
+    if (strcmp(pending.name, "wrong-argument-type") == 0) {
+        return list(gc, "qqe", pending.name, pending.type, pending.obj);
+    }
+
+    return CONS(gc, SYMBOL(gc, pending.name), INTEGER(gc, pending.count));
+}
+
+// Whether the head symbol of a failure is `name`, without building a pending error.
+bool error_named(Gc* gc, EvalResult error, const std::string& name)
+{
+    assert(error.is_error);
+
+    if (error.expr.type == EXPR_VOID) {
+        return name == gc->pending_error.name;
+    }
+
+    Expr head = cons_p(error.expr) ? CAR(error.expr) : error.expr;
+    return symbol_p(head) && head.atom->sym == name;
 }
 
 // Returns an evaluation failure indicating that a requested functionality is not implemented.
@@ -120,7 +169,11 @@ EvalResult eval_atom(Gc *gc, Scope *scope, Atom *atom)
     case ATOM_REAL:
     case ATOM_STRING:
     case ATOM_LAMBDA:
-    case ATOM_NATIVE: {
+    case ATOM_MACRO:
+    case ATOM_NATIVE:
+    case ATOM_WEAK_BOX:
+    case ATOM_WEAK_TABLE:
+    case ATOM_STRING_BUILDER: {
         return eval_success(atom_as_expr(atom));
     }
 
@@ -142,40 +195,63 @@ EvalResult eval_atom(Gc *gc, Scope *scope, Atom *atom)
                              atom_as_expr(atom)));
 }
 
+// Arguments evaluated before the first heap allocation; most calls take no more.
+#define EVAL_ARGS_INLINE 8
+
 /*
-* Recursively evaluates a list of arguments (expressions). 
-    It calls itself to evaluate each argument in the list 
+* Evaluates a list of arguments (expressions) from left to right,
     until all arguments have been successfully evaluated or an error occurs.
+
+    The values are collected first and the list is built afterwards,
+    so its conses are adjacent (see list_from_array).
+    With `in_region` the list itself is allocated in the region (see eval_funcall).
 */
-EvalResult eval_all_args(Gc *gc, Scope *scope, Expr args)
+EvalResult eval_all_args(Gc *gc, Scope *scope, Expr args, bool in_region)
 {
-    (void) scope;
-    (void) args;
-
-    switch(args.type) {
-    case EXPR_ATOM:
-        return eval_atom(gc, scope, args.atom);
+    Expr inline_values[EVAL_ARGS_INLINE];
+    std::vector<Expr> more_values;
+    size_t count = 0;
 
-    case EXPR_CONS: {
+    for (; args.type == EXPR_CONS; args = args.cons->cdr) {
         EvalResult car = eval(gc, scope, args.cons->car);
         if (car.is_error) {
             return car;
         }
 
-        EvalResult cdr = eval_all_args(gc, scope, args.cons->cdr);
-        if (cdr.is_error) {
-            return cdr;
+        if (count < EVAL_ARGS_INLINE) {
+            inline_values[count] = car.expr;
+        } else {
+            if (more_values.empty()) {
+                more_values.assign(inline_values, inline_values + EVAL_ARGS_INLINE);
+            }
+            more_values.push_back(car.expr);
         }
+        count++;
+    }
+
+    if (args.type != EXPR_ATOM) {
+        return eval_failure(CONS(gc,
+                                 SYMBOL(gc, "unexpected-expression"),
+                                 args));
+    }
 
-        return eval_success(cons_as_expr(create_cons(gc, car.expr, cdr.expr)));
+    EvalResult tail = eval_atom(gc, scope, args.atom);
+    if (tail.is_error) {
+        return tail;
     }
 
-    default: {}
+    const Expr *values = count <= EVAL_ARGS_INLINE ? inline_values : more_values.data();
+
+    if (!in_region) {
+        return eval_success(list_from_array(gc, values, count, tail.expr));
     }
 
-    return eval_failure(CONS(gc,
-                             SYMBOL(gc, "unexpected-expression"),
-                             args));
+    Expr list = tail.expr;
+    for (size_t i = count; i-- > 0;) {
+        list = cons_as_expr(region_cons(gc, values[i], list));
+    }
+
+    return eval_success(list);
 }
 
 
@@ -187,38 +263,41 @@ EvalResult eval_all_args(Gc *gc, Scope *scope, Expr args)
     inheriting the environment from the lambda definition. 
     
     It then sequentially evaluates each expression in the lambda body within this scope.
-*/
-EvalResult call_lambda(Gc *gc,
-                       Expr lambda,
-                       Expr args) {
-    if (!lambda_p(lambda)) {
-        return eval_failure(CONS(gc,
-                                 SYMBOL(gc, "expected-callable"),
-                                 lambda));
-    }
+    Macros share this with lambdas: expanding a macro is applying it to the unevaluated arguments.
 
+    Unless the body may capture it (Lambda::frame_escapes), the frame lives in the region
+    and is released on return. After an error the region is left alone, since the error
+    can refer to region data; it is reset with the next collection.
+*/
+static EvalResult apply_lambda(Gc *gc, const Lambda &lambda, Expr args)
+{
     if (!list_p(args)) {
         return eval_failure(CONS(gc,
                                  SYMBOL(gc, "expected-arguments"),
                                  args));
     }
 
-    Expr vars = lambda.atom->lambda.args_list;
+    Expr vars = lambda.args_list;
 
     if (length_of_list(args) != length_of_list(vars)) {
-        return eval_failure(CONS(gc,
-                                 SYMBOL(gc, "wrong-integer-of-arguments"),
-                                 INTEGER(gc, length_of_list(args))));
+        return wrong_integer_of_arguments(gc, length_of_list(args));
     }
 
+    const size_t mark = region_mark(gc);
+
     Scope scope = {
-        .expr = lambda.atom->lambda.envir
+        .expr = lambda.envir
     };
-    push_scope_frame(gc, &scope, vars, args);
+
+    if (lambda.frame_escapes) {
+        push_scope_frame(gc, &scope, vars, args);
+    } else {
+        push_region_scope_frame(gc, &scope, vars, args);
+    }
 
     EvalResult result = eval_success(NIL(gc));
 
-    Expr body = lambda.atom->lambda.body;
+    Expr body = lambda.optimized;
 
     while (!nil_p(body)) {
         result = eval(gc, &scope, body.cons->car);
@@ -228,9 +307,94 @@ EvalResult call_lambda(Gc *gc,
         body = body.cons->cdr;
     }
 
+    region_release(gc, mark);
+
     return result;
 }
 
+EvalResult call_lambda(Gc *gc,
+                       Expr lambda,
+                       Expr args) {
+    if (!lambda_p(lambda)) {
+        return eval_failure(CONS(gc,
+                                 SYMBOL(gc, "expected-callable"),
+                                 lambda));
+    }
+
+    Lambda& fn = lambda.atom->lambda;
+
+    if (fn.epoch != gc->epoch) {
+        optimize_lambda(gc, lambda.atom);
+        jit_release(fn.jit);
+        fn.jit = nullptr;
+        fn.calls = 0;
+        fn.deopts = 0;
+    }
+
+    if (++fn.calls == JIT_CALL_THRESHOLD) {
+        fn.jit = jit_compile(gc, lambda.atom);
+    }
+
+    if (fn.jit != nullptr) {
+        long int value;
+        if (jit_run(gc, fn.jit, args, &value)) {
+            return eval_success(INTEGER(gc, value));
+        }
+
+        // Code that keeps deoptimizing only adds its entry to every call. calls is past
+        // JIT_CALL_THRESHOLD by now, so nothing recompiles it before the epoch changes.
+        if (++fn.deopts == JIT_DEOPT_LIMIT) {
+            jit_release(fn.jit);
+            fn.jit = nullptr;
+        }
+    }
+
+    return apply_lambda(gc, fn, args);
+}
+
+/*
+* Calls an already evaluated native or lambda with already evaluated arguments.
+    Shared by eval_funcall and by ahead-of-time compiled code (see aot.cpp).
+*/
+EvalResult apply_callable(Gc *gc,
+                          Scope *scope,
+                          Expr callable,
+                          Expr args) {
+    if (callable.type == EXPR_ATOM &&
+        callable.atom->type == ATOM_NATIVE) {
+        return ((NativeFunction)callable.atom->native.fun)(
+            callable.atom->native.param, gc, scope, args);
+    }
+
+    return call_lambda(gc, callable, args);
+}
+
+/*
+* Expands a macro call site, at most once per form.
+
+    The expansion is cached against the form's cons cell together with the macro it came from.
+    As long as the head of the form still evaluates to the same macro atom the cached expansion
+    is reused; redefining the macro binds a new atom and the form is expanded again.
+    Macros therefore must not depend on anything but their arguments.
+*/
+static EvalResult expand_macro(Gc *gc, Cons *form, Atom *macro)
+{
+    auto cached = gc->macro_expansions.find(form);
+    if (cached != gc->macro_expansions.end() && cached->second.macro == macro) {
+        return eval_success(cached->second.expansion);
+    }
+
+    EvalResult result = apply_lambda(gc, macro->lambda, form->cdr);
+    if (result.is_error) {
+        return result;
+    }
+
+    Expr expansion = gc_write_barrier(gc, form, result.expr);
+    gc->macro_expansions[form] = MacroExpansion { macro, expansion };
+
+    return eval_success(expansion);
+}
+
 /*
 * Evaluates a function call. 
 
@@ -242,31 +406,379 @@ EvalResult call_lambda(Gc *gc,
     (implemented in the host language, in this case, C++) or a lambda (user-defined function), 
     
     it delegates the call to the appropriate handler.
+
+    A macro gets its arguments unevaluated, and the expansion it returns is evaluated instead of the call.
+
+    A lambda copies its arguments into its frame and a native with `borrows_args` only reads them,
+    so for those the argument list is allocated in the region and released after the call.
 */
-EvalResult eval_funcall(Gc *gc,
-                        Scope *scope,
-                        Expr callable_expr,
-                        Expr args_expr) {
+static EvalResult eval_call_form(Gc *gc,
+                                 Scope *scope,
+                                 Cons *form) {
+    Expr callable_expr = form->car;
+    Expr args_expr = form->cdr;
+
     EvalResult callable_result = eval(gc, scope, callable_expr);
     if (callable_result.is_error) {
         return callable_result;
     }
 
+    if (macro_p(callable_result.expr)) {
+        EvalResult expansion = expand_macro(gc, form, callable_result.expr.atom);
+        if (expansion.is_error) {
+            return expansion;
+        }
+
+        return eval(gc, scope, expansion.expr);
+    }
+
+    Expr callable = callable_result.expr;
+    const bool borrowed = lambda_p(callable)
+        || (callable.type == EXPR_ATOM
+            && callable.atom->type == ATOM_NATIVE
+            && callable.atom->native.borrows_args);
+
+    const size_t mark = region_mark(gc);
+
     EvalResult args_result = symbol_p(callable_expr) && is_special(callable_expr.atom->sym)
         ? eval_success(args_expr)
-        : eval_all_args(gc, scope, args_expr);
+        : eval_all_args(gc, scope, args_expr, borrowed);
 
     if (args_result.is_error) {
         return args_result;
     }
 
-    if (callable_result.expr.type == EXPR_ATOM &&
-        callable_result.expr.atom->type == ATOM_NATIVE) {
-        return ((NativeFunction)callable_result.expr.atom->native.fun)(
-            callable_result.expr.atom->native.param, gc, scope, args_result.expr);
+    EvalResult result = apply_callable(gc, scope, callable, args_result.expr);
+    if (!result.is_error) {
+        region_release(gc, mark);
     }
 
-    return call_lambda(gc, callable_result.expr, args_result.expr);
+    return result;
+}
+
+/*
+* Runs every EVAL_CHECK_INTERVAL steps, or when the step limit is due.
+    Settles the steps of the slice that ended and checks the limit and the deadline.
+    Once the budget is exhausted it stays so until the next top-level form,
+    every step fails again, and `condition-case` cannot keep a runaway script alive.
+*/
+static EvalResult eval_checkpoint(Gc *gc)
+{
+    if (gc->budget_exhausted == nullptr) {
+        gc->steps_used += gc->steps_in_slice;
+
+        if (gc->step_limit > 0 && gc->steps_used >= gc->step_limit) {
+            gc->budget_exhausted = "fuel-exhausted";
+        } else if (gc->time_limit_ms > 0 && std::chrono::steady_clock::now() >= gc->deadline) {
+            gc->budget_exhausted = "timeout";
+        }
+    }
+
+    if (gc->budget_exhausted != nullptr) {
+        gc->steps_in_slice = 0;
+        gc->steps_until_check = 0;
+        return eval_failure(CONS(gc, SYMBOL(gc, gc->budget_exhausted), NIL(gc)));
+    }
+
+    unsigned long int slice = EVAL_CHECK_INTERVAL;
+    if (gc->step_limit > 0 && gc->step_limit - gc->steps_used < slice) {
+        slice = gc->step_limit - gc->steps_used;
+    }
+
+    gc->steps_in_slice = (long int) slice;
+    gc->steps_until_check = (long int) slice;
+
+    return eval_success(NIL(gc));
+}
+
+/*
+* Spends one step of the evaluation budget (Gc::step_limit, Gc::time_limit_ms,
+    and the memory limits enforced by gc_add_expr).
+    A step is a call, or an iteration of a loop that makes none. The common case
+    is one decrement; the clock is only read at checkpoints.
+*/
+EvalResult eval_step(Gc *gc)
+{
+    if (--gc->steps_until_check > 0) {
+        return eval_success(NIL(gc));
+    }
+
+    return eval_checkpoint(gc);
+}
+
+// Steps left before the step limit, or a very large number without one. 0 once exhausted.
+long int eval_steps_left(const Gc *gc)
+{
+    if (gc->budget_exhausted != nullptr) {
+        return 0;
+    }
+
+    if (gc->step_limit == 0) {
+        return LONG_MAX / 2;
+    }
+
+    const unsigned long int used = gc->steps_used + (gc->steps_in_slice - gc->steps_until_check);
+    return used >= gc->step_limit ? 0 : (long int) (gc->step_limit - used);
+}
+
+/*
+* Charges steps taken outside of eval_step (see jit_run). The current slice is settled
+    early, so the next eval_step runs a checkpoint.
+*/
+void eval_charge_steps(Gc *gc, unsigned long int steps)
+{
+    gc->steps_used += gc->steps_in_slice - gc->steps_until_check + steps;
+    gc->steps_in_slice = 0;
+    gc->steps_until_check = 0;
+}
+
+// Starts the budget of a new top-level evaluation.
+static void reset_eval_budget(Gc *gc)
+{
+    gc->steps_used = 0;
+    gc->steps_in_slice = 0;
+    gc->steps_until_check = 0;
+    gc->budget_exhausted = nullptr;
+    gc->allocated = 0;
+
+    if (gc->time_limit_ms > 0) {
+        gc->deadline = std::chrono::steady_clock::now()
+            + std::chrono::milliseconds(gc->time_limit_ms);
+    }
+}
+
+/*
+* Counts the nesting of calls, so runaway recursion ends in a stack-overflow error
+    at Gc::max_eval_depth rather than in a crash.
+*/
+EvalResult eval_funcall(Gc *gc,
+                        Scope *scope,
+                        Cons *form) {
+    if (gc->eval_depth >= gc->max_eval_depth) {
+        return eval_failure(CONS(gc,
+                                 SYMBOL(gc, "stack-overflow"),
+                                 INTEGER(gc, (long int) gc->max_eval_depth)));
+    }
+
+    EvalResult step = eval_step(gc);
+    if (step.is_error) {
+        return step;
+    }
+
+    gc->eval_depth++;
+    EvalResult result = eval_call_form(gc, scope, form);
+    gc->eval_depth--;
+
+    return result;
+}
+
+struct TopLevelCall {
+    Gc *gc;
+    Scope *scope;
+    Expr expr;
+    EvalResult result;
+    ucontext_t caller;
+    ucontext_t callee;
+};
+
+static thread_local TopLevelCall *top_level_call = nullptr;
+
+/*
+* Evaluates a top-level form with the memory limits armed (see gc_charge).
+    A form that runs out of memory is unwound to here: its scope frames, region memory
+    and catch tags are dropped and the budget stays exhausted, which tells eval_top_level
+    to collect and fail with memory-exhausted.
+*/
+static EvalResult eval_form(Gc *gc, Scope *scope, Expr expr)
+{
+    const size_t depth = scope_depth(scope);
+    const size_t mark = region_mark(gc);
+    const size_t catches = gc->catch_tags.size();
+
+    gc->memory_checked = true;
+
+    try {
+        EvalResult result = eval(gc, scope, expr);
+        gc->memory_checked = false;
+        return result;
+    } catch (const MemoryExhausted&) {
+        while (scope_depth(scope) > depth) {
+            pop_scope_frame(gc, scope);
+        }
+        region_release(gc, mark);
+        gc->catch_tags.resize(catches);
+        gc->budget_exhausted = "memory-exhausted";
+
+        return eval_failure(NIL(gc));
+    }
+}
+
+static bool memory_exhausted(const Gc *gc)
+{
+    return gc->budget_exhausted != nullptr && strcmp(gc->budget_exhausted, "memory-exhausted") == 0;
+}
+
+static void run_top_level_call()
+{
+    TopLevelCall *call = top_level_call;
+    call->result = eval_form(call->gc, call->scope, call->expr);
+}
+
+// Reserves a stack deep enough for max_eval_depth, with a guard page at its end.
+static bool reserve_eval_stack(Gc *gc)
+{
+    if (gc->max_eval_depth > SIZE_MAX / EVAL_STACK_BYTES_PER_LEVEL) {
+        return false;
+    }
+
+    const size_t size = gc->max_eval_depth * EVAL_STACK_BYTES_PER_LEVEL;
+    if (gc->eval_stack != nullptr && gc->eval_stack_size == size) {
+        return true;
+    }
+
+    if (gc->eval_stack != nullptr) {
+        munmap(gc->eval_stack, gc->eval_stack_size);
+        gc->eval_stack = nullptr;
+        gc->eval_stack_size = 0;
+    }
+
+    void *stack = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) {
+        return false;
+    }
+
+    mprotect(stack, (size_t) sysconf(_SC_PAGESIZE), PROT_NONE);
+
+    gc->eval_stack = stack;
+    gc->eval_stack_size = size;
+
+    return true;
+}
+
+/*
+* How many levels of nesting fit on the thread's own stack, for when no eval stack
+    could be reserved. Only half of the stack limit is counted, as the caller's frames
+    already use part of it.
+*/
+static size_t thread_stack_depth()
+{
+    size_t size = THREAD_STACK_BYTES;
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        size = (size_t) limit.rlim_cur;
+    }
+
+    return size / 2 / EVAL_STACK_BYTES_PER_LEVEL;
+}
+
+/*
+* Evaluates a top-level form on a stack of its own.
+
+    A Lisp call takes several C++ frames (eval, eval_funcall, call_lambda, ...),
+    so on the thread's stack non-tail recursion over a long list crashes long before
+    memory runs out. Here the C++ stack is sized for Gc::max_eval_depth levels,
+    which makes the depth limit, and with it stack-overflow, the only bound.
+
+    The stack is switched to once per top-level form, so shallow code pays nothing per call.
+    Nested use (e.g. `load` from within a form) simply continues on the current stack.
+    So does a form whose stack cannot be reserved, with the depth limit lowered
+    to what the current stack holds.
+
+    Each top-level form also gets a fresh evaluation budget (see eval_step).
+*/
+static EvalResult eval_on_eval_stack(Gc *gc, Scope *scope, Expr expr)
+{
+    if (!reserve_eval_stack(gc)) {
+        const size_t max_eval_depth = gc->max_eval_depth;
+        gc->max_eval_depth = std::min(max_eval_depth, thread_stack_depth());
+
+        EvalResult result = eval_form(gc, scope, expr);
+
+        gc->max_eval_depth = max_eval_depth;
+        gc->eval_depth = 0;
+
+        return result;
+    }
+
+    TopLevelCall call = {
+        .gc = gc,
+        .scope = scope,
+        .expr = expr,
+        .result = eval_success(NIL(gc)),
+    };
+
+    getcontext(&call.callee);
+    call.callee.uc_stack.ss_sp = gc->eval_stack;
+    call.callee.uc_stack.ss_size = gc->eval_stack_size;
+    call.callee.uc_link = &call.caller;
+    makecontext(&call.callee, run_top_level_call, 0);
+
+    top_level_call = &call;
+    swapcontext(&call.caller, &call.callee);
+    top_level_call = nullptr;
+
+    gc->eval_depth = 0;
+
+    return call.result;
+}
+
+/*
+* Runs the finalizers the last collection found due, each as a call without arguments
+    with a budget of its own. There is nobody to report their errors to, so they are dropped.
+*/
+static void run_finalizers(Gc *gc, Scope *scope)
+{
+    for (Expr callable : gc_take_finalizers(gc)) {
+        reset_eval_budget(gc);
+        eval_on_eval_stack(gc, scope, CONS(gc, callable, NIL(gc)));
+    }
+}
+
+/*
+* Evaluates a form typed at the top level or read from a file.
+    With Gc::request_per_form set the form is a request (see gc_begin_request):
+    only its value and what it stored into the global environment survive it.
+* A form that runs out of memory (see gc_charge) fails with memory-exhausted after
+    a collection that gives back what it allocated. The form and the global scope are
+    the only roots of that collection, so callers read one form at a time, as the repl does.
+*/
+EvalResult eval_top_level(Gc *gc, Scope *scope, Expr expr)
+{
+    // Errors leave here as lists, a pending error would not survive the next form.
+    if (top_level_call != nullptr) {
+        EvalResult result = eval(gc, scope, expr);
+        if (result.is_error) {
+            result.expr = error_object(gc, result);
+        }
+
+        return result;
+    }
+
+    run_finalizers(gc, scope);
+    reset_eval_budget(gc);
+
+    const bool request = gc->request_per_form;
+    if (request) {
+        gc_begin_request(gc);
+    }
+
+    EvalResult result = eval_on_eval_stack(gc, scope, expr);
+    if (result.is_error) {
+        result.expr = error_object(gc, result);
+    }
+
+    if (request) {
+        result.expr = gc_end_request(gc, result.expr);
+    }
+
+    if (memory_exhausted(gc)) {
+        gc_collect(gc, CONS(gc, expr, scope->expr));
+        result = eval_failure(CONS(gc, SYMBOL(gc, "memory-exhausted"), NIL(gc)));
+    }
+
+    return result;
 }
 
 /*
@@ -310,7 +822,7 @@ EvalResult eval(Gc *gc, Scope *scope, Expr expr)
         return eval_atom(gc, scope, expr.atom);
 
     case EXPR_CONS:
-        return eval_funcall(gc, scope, expr.cons->car, expr.cons->cdr);
+        return eval_funcall(gc, scope, expr.cons);
 
     default: {}
     }
@@ -396,7 +908,7 @@ EvalResult match_list(Gc* gc, const char* format, Expr xs, ...) {
 
             const char** p = va_arg<const char**>(args_list, const char**);
             if (p != NULL) {
-                *p = x.atom->str;
+                *p = x.atom->str.c_str();
             }
         } break;
 
@@ -12,6 +12,7 @@
 #include "expr.hpp"
 #include "scope.hpp"
 #include "gc.hpp"
+#include "optimizer.hpp"
 
 EvalResult eval_failure(Expr error);
 
@@ -21,14 +22,26 @@ EvalResult wrong_integer_of_arguments(Gc* gc, long int count);
 
 EvalResult not_implemented(Gc* gc);
 
+Expr error_object(Gc* gc, EvalResult error);
+
+bool error_named(Gc* gc, EvalResult error, const std::string& name);
+
 EvalResult read_error(Gc* gc, const std::string& error_message, long int character);
 
 EvalResult car(Gc* gc, Scope* scope, Expr args);
 
 EvalResult eval(Gc* gc, Scope* scope, Expr expr);
 
+EvalResult eval_top_level(Gc* gc, Scope* scope, Expr expr);
+
+EvalResult eval_step(Gc* gc);
+long int eval_steps_left(const Gc* gc);
+void eval_charge_steps(Gc* gc, unsigned long int steps);
+
 EvalResult eval_block(Gc* gc, Scope* scope, Expr block);
 
+EvalResult apply_callable(Gc* gc, Scope* scope, Expr callable, Expr args);
+
 EvalResult match_list(Gc* gc, const char* format, Expr xs, ...);
 
 #endif  // INTERPRETER_H_
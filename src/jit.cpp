@@ -0,0 +1,508 @@
+// jit.cpp
+
+/*
+* Problem: the hottest functions of numeric code, e.g. `(defun poly (x y) (+ (* x x) (* 3 y) 7))`
+    or `(defun fib (n) (if (> 2 n) n (+ (fib (+ n -1)) (fib (+ n -2)))))`,
+    spend nearly all of their time walking the body through eval, eval_funcall and plus_op,
+    boxing every intermediate integer.
+
+* Solution: a baseline JIT. Once call_lambda has seen a lambda JIT_CALL_THRESHOLD times,
+    its optimized body is translated to x86-64 machine code, written into an mmap'd page
+    that is then made executable.
+
+    Supported bodies are a single expression built from:
+    - integer literals,
+    - parameters,
+    - `+` and `*` bound globally to the builtin plus_op and mul_op natives,
+    - `if` and `when` whose test is a comparison of two integers with the builtin `>`,
+    - calls of the lambda itself (recursion), with as many arguments as it takes.
+
+    Everything is computed on unboxed 64-bit integers in registers; the value of the body
+    must be an integer too (a fixnum function). Self-calls are machine calls that pass
+    their arguments on the stack.
+
+* Guards and deoptimization:
+    - jit_run checks the arity and that every argument is an integer (fixnum guard)
+      before entering the code.
+    - The code itself bails out on signed overflow (`jo`), when an `if` without else forms
+      or a `when` would produce nil, and when a self-call finds its budget spent:
+      the calls left before stack-overflow and the steps left of the evaluation budget
+      (see eval_step). With a time limit the steps are capped at JIT_STEPS_PER_CLOCK_CHECK,
+      so the interpreter gets to look at the clock.
+    In all cases jit_run returns false and call_lambda interprets the body as usual,
+    which raises whatever error is due. Supported bodies have no side effects, so starting
+    over in the interpreter is always safe. After JIT_DEOPT_LIMIT deoptimizations
+    call_lambda drops the code and interprets the lambda until the next epoch.
+    The code relies on `+`, `*`, `>`, `if`, `when` and the name of the lambda keeping their
+    meaning; rebinding them bumps Gc::epoch, and call_lambda then throws the code away
+    together with the stale optimized body.
+
+* Generated code follows the System V ABI:
+    int code(const long int* args, long int* result, JitBudget* budget)
+    returns 0 and stores the result on success, returns 1 to deoptimize.
+    Every invocation keeps rbp as frame pointer and saves its arguments below it:
+        [rbp - 8] args, [rbp - 16] result, [rbp - 24] budget, [rbp - 32] result of self-calls
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "builtins.hpp"
+#include "jit.hpp"
+#include "scope.hpp"
+#include "std.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_ENABLED 1
+#include <sys/mman.h>
+#else
+#define JIT_ENABLED 0
+#endif
+
+// Counted down by self-calls; either going negative deoptimizes.
+struct JitBudget {
+    long int depth;     // nested calls left before stack-overflow
+    long int steps;     // steps left of the evaluation budget
+};
+
+using JitFunction = int (*)(const long int* args, long int* result, JitBudget* budget);
+
+struct JitCode {
+    void* memory;
+    size_t size;
+    long int arity;
+};
+
+#if JIT_ENABLED
+
+struct Assembler {
+    std::vector<uint8_t> code;
+    std::vector<size_t> deopt_jumps;    // offsets of rel32 operands to patch
+};
+
+// What compile_expr needs to know about the lambda being compiled.
+struct JitTarget {
+    Scope* scope;
+    Expr vars;
+    Atom* self;
+    long int arity;
+};
+
+static void emit(Assembler& as, std::initializer_list<uint8_t> bytes)
+{
+    as.code.insert(as.code.end(), bytes);
+}
+
+static void emit_u32(Assembler& as, uint32_t x)
+{
+    for (int i = 0; i < 4; ++i) {
+        as.code.push_back((uint8_t) (x >> (8 * i)));
+    }
+}
+
+static void emit_u64(Assembler& as, uint64_t x)
+{
+    for (int i = 0; i < 8; ++i) {
+        as.code.push_back((uint8_t) (x >> (8 * i)));
+    }
+}
+
+// Emits a jump with a rel32 operand and returns the offset of the operand, see patch_jump.
+static size_t emit_jump(Assembler& as, std::initializer_list<uint8_t> opcode)
+{
+    emit(as, opcode);
+    const size_t operand = as.code.size();
+    emit_u32(as, 0);
+    return operand;
+}
+
+// Points a jump emitted by emit_jump at the current end of the code.
+static void patch_jump(Assembler& as, size_t operand)
+{
+    const int32_t rel = (int32_t) (as.code.size() - (operand + 4));
+    std::memcpy(&as.code[operand], &rel, sizeof(rel));
+}
+
+// A jump to deopt, the target is patched once the deopt stub is emitted.
+static void emit_jump_deopt(Assembler& as, std::initializer_list<uint8_t> opcode)
+{
+    as.deopt_jumps.push_back(emit_jump(as, opcode));
+}
+
+static void emit_jo_deopt(Assembler& as)
+{
+    emit_jump_deopt(as, {0x0F, 0x80});
+}
+
+// Returns the index of a parameter, or -1.
+static long int parameter_index(Expr vars, Expr name)
+{
+    long int index = 0;
+
+    for (; cons_p(vars); vars = CDR(vars), ++index) {
+        if (CAR(vars).atom->sym == name.atom->sym) {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+// Resolves the head of a call to what it is globally bound to, if it is not shadowed.
+static Atom* global_atom(const JitTarget& target, Expr name)
+{
+    if (!symbol_p(name) || parameter_index(target.vars, name) >= 0) {
+        return nullptr;
+    }
+
+    Expr cell = get_scope_value(target.scope, name);
+    if (nil_p(cell) || cell.cons != get_global_scope_value(target.scope, name).cons) {
+        return nullptr;
+    }
+
+    Expr value = CDR(cell);
+    return value.type == EXPR_ATOM ? value.atom : nullptr;
+}
+
+static NativeFunction global_native(const JitTarget& target, Expr name)
+{
+    Atom* atom = global_atom(target, name);
+    if (atom == nullptr || atom->type != ATOM_NATIVE) {
+        return nullptr;
+    }
+
+    return atom->native.fun;
+}
+
+static bool compile_expr(Assembler& as, const JitTarget& target, Expr expr);
+
+// Compiles the forms of a block, leaving the value of the last one in rax.
+static bool compile_block(Assembler& as, const JitTarget& target, Expr block)
+{
+    if (nil_p(block)) {
+        emit_jump_deopt(as, {0xE9});                // jmp deopt, the value would be nil
+        return true;
+    }
+
+    for (; cons_p(block); block = CDR(block)) {
+        if (!compile_expr(as, target, CAR(block))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Compiles the test of an if or when, `(> a b)`. Returns the operand of the jump taken if it fails.
+static bool compile_test(Assembler& as, const JitTarget& target, Expr test, size_t* otherwise)
+{
+    if (!cons_p(test) || !list_p(test) || length_of_list(test) != 3
+        || global_native(target, CAR(test)) != greaterThan) {
+        return false;
+    }
+
+    if (!compile_expr(as, target, CAR(CDR(test)))) {
+        return false;
+    }
+    emit(as, {0x50});                               // push rax
+    if (!compile_expr(as, target, CAR(CDR(CDR(test))))) {
+        return false;
+    }
+    emit(as, {0x48, 0x89, 0xC1});                   // mov rcx, rax
+    emit(as, {0x58});                               // pop rax
+    emit(as, {0x48, 0x39, 0xC8});                   // cmp rax, rcx
+
+    *otherwise = emit_jump(as, {0x0F, 0x8E});       // jle otherwise
+    return true;
+}
+
+/*
+* (if test then else...) and (when test body...).
+    A when whose test fails and an if without else forms are nil: they deoptimize.
+*/
+static bool compile_conditional(Assembler& as, const JitTarget& target, NativeFunction op, Expr args)
+{
+    size_t otherwise = 0;
+    if (!cons_p(args) || !compile_test(as, target, CAR(args), &otherwise)) {
+        return false;
+    }
+
+    if (op == when) {
+        as.deopt_jumps.push_back(otherwise);
+        return compile_block(as, target, CDR(args));
+    }
+
+    if (!cons_p(CDR(args)) || !compile_expr(as, target, CAR(CDR(args)))) {
+        return false;
+    }
+
+    const size_t end = emit_jump(as, {0xE9});       // jmp end
+    patch_jump(as, otherwise);
+    if (!compile_block(as, target, CDR(CDR(args)))) {
+        return false;
+    }
+    patch_jump(as, end);
+
+    return true;
+}
+
+/*
+* A call of the lambda being compiled. The arguments are evaluated last to first,
+    which is unobservable since the code has no side effects, and pushed,
+    which leaves them in order at rsp.
+*/
+static bool compile_self_call(Assembler& as, const JitTarget& target, Expr args)
+{
+    if (length_of_list(args) != target.arity) {
+        return false;
+    }
+
+    std::vector<Expr> values;
+    for (; cons_p(args); args = CDR(args)) {
+        values.push_back(CAR(args));
+    }
+
+    for (auto value = values.rbegin(); value != values.rend(); ++value) {
+        if (!compile_expr(as, target, *value)) {
+            return false;
+        }
+        emit(as, {0x50});                           // push rax
+    }
+
+    emit(as, {0x48, 0x8B, 0x55, 0xE8});             // mov rdx, [rbp - 24]
+    emit(as, {0x48, 0x83, 0x2A, 0x01});             // sub qword [rdx], 1
+    emit_jump_deopt(as, {0x0F, 0x88});              // js deopt
+    emit(as, {0x48, 0x83, 0x6A, 0x08, 0x01});       // sub qword [rdx + 8], 1
+    emit_jump_deopt(as, {0x0F, 0x88});              // js deopt
+
+    emit(as, {0x48, 0x89, 0xE7});                   // mov rdi, rsp
+    emit(as, {0x48, 0x8D, 0x75, 0xE0});             // lea rsi, [rbp - 32]
+    emit(as, {0xE8});                               // call entry
+    emit_u32(as, (uint32_t) (int32_t) -(int64_t) (as.code.size() + 4));
+
+    emit(as, {0x85, 0xC0});                         // test eax, eax
+    emit_jump_deopt(as, {0x0F, 0x85});              // jnz deopt
+
+    emit(as, {0x48, 0x8B, 0x55, 0xE8});             // mov rdx, [rbp - 24]
+    emit(as, {0x48, 0x83, 0x02, 0x01});             // add qword [rdx], 1
+    if (!values.empty()) {
+        emit(as, {0x48, 0x81, 0xC4});               // add rsp, imm32
+        emit_u32(as, (uint32_t) (values.size() * sizeof(long int)));
+    }
+    emit(as, {0x48, 0x8B, 0x45, 0xE0});             // mov rax, [rbp - 32]
+
+    return true;
+}
+
+/*
+* Emits code that leaves the value of `expr` in rax.
+    Intermediate values are kept on the machine stack.
+*/
+static bool compile_expr(Assembler& as, const JitTarget& target, Expr expr)
+{
+    if (integer_p(expr)) {
+        emit(as, {0x48, 0xB8});                     // movabs rax, imm64
+        emit_u64(as, (uint64_t) expr.atom->num);
+        return true;
+    }
+
+    if (symbol_p(expr)) {
+        const long int index = parameter_index(target.vars, expr);
+        if (index < 0) {
+            return false;
+        }
+
+        emit(as, {0x48, 0x8B, 0x45, 0xF8});         // mov rax, [rbp - 8]
+        emit(as, {0x48, 0x8B, 0x80});               // mov rax, [rax + disp32]
+        emit_u32(as, (uint32_t) (index * sizeof(long int)));
+        return true;
+    }
+
+    if (!cons_p(expr) || !list_p(expr)) {
+        return false;
+    }
+
+    if (global_atom(target, CAR(expr)) == target.self) {
+        return compile_self_call(as, target, CDR(expr));
+    }
+
+    const NativeFunction op = global_native(target, CAR(expr));
+    if (op == if_op || op == when) {
+        return compile_conditional(as, target, op, CDR(expr));
+    }
+
+    if (op != plus_op && op != mul_op) {
+        return false;
+    }
+
+    Expr args = CDR(expr);
+    if (nil_p(args)) {
+        emit(as, {0x48, 0xB8});                     // movabs rax, identity
+        emit_u64(as, op == plus_op ? 0 : 1);
+        return true;
+    }
+
+    if (!compile_expr(as, target, CAR(args))) {
+        return false;
+    }
+
+    for (args = CDR(args); !nil_p(args); args = CDR(args)) {
+        emit(as, {0x50});                           // push rax
+        if (!compile_expr(as, target, CAR(args))) {
+            return false;
+        }
+        emit(as, {0x48, 0x89, 0xC1});               // mov rcx, rax
+        emit(as, {0x58});                           // pop rax
+
+        if (op == plus_op) {
+            emit(as, {0x48, 0x01, 0xC8});           // add rax, rcx
+        } else {
+            emit(as, {0x48, 0x0F, 0xAF, 0xC1});     // imul rax, rcx
+        }
+        emit_jo_deopt(as);
+    }
+
+    return true;
+}
+
+JitCode* jit_compile(Gc* gc, Atom* lambda)
+{
+    assert(gc);
+    assert(lambda);
+    assert(lambda->type == ATOM_LAMBDA);
+
+    const Lambda& fn = lambda->lambda;
+    const long int arity = length_of_list(fn.args_list);
+
+    if (arity > JIT_MAX_ARGS || !cons_p(fn.optimized) || !nil_p(CDR(fn.optimized))) {
+        return nullptr;
+    }
+
+    Scope scope = {
+        .expr = fn.envir
+    };
+
+    const JitTarget target = {
+        .scope = &scope,
+        .vars = fn.args_list,
+        .self = lambda,
+        .arity = arity
+    };
+
+    Assembler as;
+    emit(as, {0x55});                               // push rbp
+    emit(as, {0x48, 0x89, 0xE5});                   // mov rbp, rsp
+    emit(as, {0x57, 0x56, 0x52, 0x50});             // push rdi, rsi, rdx and a slot
+
+    if (!compile_expr(as, target, CAR(fn.optimized))) {
+        return nullptr;
+    }
+
+    emit(as, {0x48, 0x8B, 0x75, 0xF0});             // mov rsi, [rbp - 16]
+    emit(as, {0x48, 0x89, 0x06});                   // mov [rsi], rax
+    emit(as, {0x31, 0xC0});                         // xor eax, eax
+    emit(as, {0xC9});                               // leave
+    emit(as, {0xC3});                               // ret
+
+    const size_t deopt = as.code.size();
+    emit(as, {0xB8, 0x01, 0x00, 0x00, 0x00});       // mov eax, 1
+    emit(as, {0xC9});                               // leave
+    emit(as, {0xC3});                               // ret
+
+    for (size_t jump : as.deopt_jumps) {
+        const int32_t rel = (int32_t) (deopt - (jump + 4));
+        std::memcpy(&as.code[jump], &rel, sizeof(rel));
+    }
+
+    void* memory = mmap(nullptr, as.code.size(), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+
+    std::memcpy(memory, as.code.data(), as.code.size());
+
+    if (mprotect(memory, as.code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, as.code.size());
+        return nullptr;
+    }
+
+    return new JitCode { memory, as.code.size(), arity };
+}
+
+bool jit_run(Gc* gc, const JitCode* code, Expr args, long int* result)
+{
+    assert(gc);
+    assert(code);
+
+    long int values[JIT_MAX_ARGS];
+    long int n = 0;
+
+    for (; cons_p(args); args = CDR(args), ++n) {
+        if (n >= code->arity || !integer_p(CAR(args))) {
+            return false;
+        }
+        values[n] = CAR(args).atom->num;
+    }
+
+    if (n != code->arity || !nil_p(args)) {
+        return false;
+    }
+
+    JitBudget budget = {
+        .depth = (long int) (gc->max_eval_depth - gc->eval_depth),
+        .steps = eval_steps_left(gc),
+    };
+
+    if (gc->time_limit_ms > 0) {
+        budget.steps = std::min(budget.steps, (long int) JIT_STEPS_PER_CLOCK_CHECK);
+    }
+
+    const long int steps = budget.steps;
+    if (reinterpret_cast<JitFunction>(code->memory)(values, result, &budget) != 0) {
+        return false;
+    }
+
+    eval_charge_steps(gc, (unsigned long int) (steps - budget.steps));
+    return true;
+}
+
+void jit_release(JitCode* code)
+{
+    if (code == nullptr) {
+        return;
+    }
+
+    munmap(code->memory, code->size);
+    delete code;
+}
+
+#else  // JIT_ENABLED
+
+JitCode* jit_compile(Gc* gc, Atom* lambda)
+{
+    (void) gc;
+    (void) lambda;
+    return nullptr;
+}
+
+bool jit_run(Gc* gc, const JitCode* code, Expr args, long int* result)
+{
+    (void) gc;
+    (void) code;
+    (void) args;
+    (void) result;
+    return false;
+}
+
+void jit_release(JitCode* code)
+{
+    assert(code == nullptr);
+}
+
+#endif  // JIT_ENABLED
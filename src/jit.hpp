@@ -0,0 +1,35 @@
+#ifndef JIT_H_
+#define JIT_H_
+
+#pragma once
+
+#include "expr.hpp"
+#include "gc.hpp"
+
+// How many calls a lambda takes in call_lambda before it is compiled.
+#define JIT_CALL_THRESHOLD 1000
+// How many times compiled code may deoptimize before call_lambda gives it up until the next epoch.
+#define JIT_DEOPT_LIMIT 8
+#define JIT_MAX_ARGS 8
+// Self-calls compiled code may make between two looks at the clock, when a time limit is set.
+#define JIT_STEPS_PER_CLOCK_CHECK (1 << 20)
+
+struct JitCode;
+
+/*
+* Compiles the optimized body of a lambda to native code.
+    Returns nullptr if the body is outside of what the JIT supports
+    or the host is not x86-64 Linux; the lambda is then simply interpreted.
+*/
+JitCode* jit_compile(Gc* gc, Atom* lambda);
+
+/*
+* Runs compiled code on an argument list, charging its self-calls to the evaluation budget.
+    Returns false (deoptimizes) when the arguments are not all integers, the computation
+    overflows or produces nil, or the budget runs out; the caller must then interpret the body.
+*/
+bool jit_run(Gc* gc, const JitCode* code, Expr args, long int* result);
+
+void jit_release(JitCode* code);
+
+#endif  // JIT_H_
@@ -0,0 +1,572 @@
+// optimizer.cpp
+
+/*
+* Problem: lambda bodies are re-evaluated exactly as they were written,
+    so `(* 60 60 24)` inside a defun is recomputed through eval_funcall on every call.
+
+* Solution: when a lambda is created, its body is rewritten once into an equivalent,
+    cheaper form that call_lambda evaluates instead of the original:
+
+    1) Calls to pure natives (see set_pure_native) whose arguments are all constants
+       are evaluated at optimization time and replaced by their result.
+
+    2) `(quote x)` of self-evaluating data is replaced by `x`, 
+       and quoted data is a constant argument for 1).
+
+    3) `(when c body...)` with a constant condition becomes `(begin body...)` or `nil`.
+
+    4) References to names bound with defconst are replaced by their value.
+
+    5) Calls to small, non-recursive global functions are inlined (see inline_call),
+       and the inlined body is optimized again in the caller, so `(square 3)` becomes 9.
+
+    Every assumption is about a global binding: a name that is a parameter of the lambda
+    is never folded, and neither is a name bound in an enclosing local frame.
+    Rebinding a global function or constant bumps Gc::epoch (see set_scope_value),
+    which makes every optimized body stale; call_lambda redoes it on the next call.
+
+    The optimized body is also checked for anything that could keep the call frame
+    alive after the call (see may_capture_frame); if there is nothing, apply_lambda
+    allocates the frame in the region instead of the heap.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#define INLINE_MAX_NODES 16
+#define INLINE_MAX_DEPTH 4
+
+#include "builtins.hpp"
+#include "interpreter.hpp"
+#include "optimizer.hpp"
+
+struct Optimizer {
+    Gc* gc;
+    Scope* scope;
+    std::vector<Expr> bound;    // parameters of the lambda being optimized
+    int inline_depth;           // how many inlined calls we are nested in
+};
+
+// Checks if a symbol is a parameter of the lambda being optimized.
+static bool locally_bound_p(const Optimizer& optimizer, Expr name)
+{
+    for (const Expr& var : optimizer.bound) {
+        if (var.atom->sym == name.atom->sym) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+* Returns the global value cell of a name, or nil if the name is
+    unbound or shadowed by a local binding at optimization time.
+*/
+static Expr global_binding(const Optimizer& optimizer, Expr name)
+{
+    if (!symbol_p(name) || locally_bound_p(optimizer, name)) {
+        return NIL(optimizer.gc);
+    }
+
+    Expr cell = get_scope_value(optimizer.scope, name);
+    if (nil_p(cell) || cell.cons != get_global_scope_value(optimizer.scope, name).cons) {
+        return NIL(optimizer.gc);
+    }
+
+    return cell;
+}
+
+// Data that evaluates to itself.
+static bool self_evaluating_p(Expr expr)
+{
+    return integer_p(expr) || real_p(expr) || string_p(expr);
+}
+
+// The canonical nil and t, which the standard library binds to themselves.
+static bool canonical_p(Expr expr)
+{
+    return expr.type == EXPR_ATOM && (expr.atom == nil_atom || expr.atom == t_atom);
+}
+
+/*
+* Checks if an optimized expression always evaluates to the same value,
+    and stores that value in `value`.
+*/
+static bool constant_p(const Optimizer& optimizer, Expr expr, Expr* value)
+{
+    if (self_evaluating_p(expr)
+        || (canonical_p(expr) && !locally_bound_p(optimizer, expr))) {
+        *value = expr;
+        return true;
+    }
+
+    if (cons_p(expr) && symbol_p(CAR(expr)) && CAR(expr).atom->sym == "quote"
+        && !locally_bound_p(optimizer, CAR(expr))
+        && cons_p(CDR(expr)) && nil_p(CDR(CDR(expr)))) {
+        *value = CAR(CDR(expr));
+        return true;
+    }
+
+    return false;
+}
+
+// Turns a folded value back into an expression that evaluates to it.
+static Expr constant_as_expr(Gc* gc, Expr value)
+{
+    if (self_evaluating_p(value) || canonical_p(value)) {
+        return value;
+    }
+
+    return list(gc, "qe", "quote", value);
+}
+
+static Expr optimize_expr(Optimizer& optimizer, Expr expr);
+
+// Optimizes every element of a list of expressions.
+static Expr optimize_list(Optimizer& optimizer, Expr xs)
+{
+    if (!cons_p(xs)) {
+        return xs;
+    }
+
+    return CONS(optimizer.gc,
+                optimize_expr(optimizer, CAR(xs)),
+                optimize_list(optimizer, CDR(xs)));
+}
+
+// (when c body...) with a constant condition.
+static Expr optimize_when(Optimizer& optimizer, Expr form)
+{
+    Gc* gc = optimizer.gc;
+
+    if (!cons_p(CDR(form))) {
+        return form;
+    }
+
+    Expr condition = optimize_expr(optimizer, CAR(CDR(form)));
+    Expr body = optimize_list(optimizer, CDR(CDR(form)));
+
+    Expr value = void_expr();
+    if (constant_p(optimizer, condition, &value)) {
+        return nil_p(value) ? NIL(gc) : CONS(gc, SYMBOL(gc, "begin"), body);
+    }
+
+    return CONS(gc, CAR(form), CONS(gc, condition, body));
+}
+
+/*
+* ### Inlining
+
+    A call `(f a b)` is replaced by the body of f with its parameters substituted when:
+    - f is a global lambda that closes over nothing but the global scope,
+    - its body is a single small expression made of calls, quote, when and begin only,
+      so there is no binding form in it that could capture the substituted arguments
+      and no macro that would expand over them,
+    - the body does not mention f itself (inlining also stops at INLINE_MAX_DEPTH,
+      which covers mutual recursion),
+    - every free name of the body still means the global binding at the call site,
+    - every argument that is not a constant is read unconditionally, the first reads follow
+      the order of the arguments, and all of them come before the body calls anything.
+      An argument that is more than a variable is read exactly once.
+      So no argument is evaluated twice or skipped, no void-variable error is lost, and
+      nothing the body calls can run before an argument or change a variable it reads.
+    Rebinding f bumps Gc::epoch, which throws the inlined copies away.
+*/
+
+// Counts cons cells, giving up as soon as the limit is exceeded.
+static long int count_nodes(Expr expr, long int limit)
+{
+    long int count = 0;
+
+    while (cons_p(expr) && count <= limit) {
+        count += 1 + count_nodes(CAR(expr), limit - count);
+        expr = CDR(expr);
+    }
+
+    return count;
+}
+
+// Checks that a body only consists of forms that can be inlined safely.
+static bool inlinable_expr_p(const Optimizer& optimizer, Expr expr, Expr self)
+{
+    if (symbol_p(expr)) {
+        return expr.atom->sym != self.atom->sym;
+    }
+
+    if (!cons_p(expr)) {
+        return true;
+    }
+
+    if (!symbol_p(CAR(expr)) || !list_p(expr)) {
+        return false;
+    }
+
+    const std::string& name = CAR(expr).atom->sym;
+    if (name == "quote") {
+        return true;
+    }
+
+    if (is_special(name) && name != "when" && name != "begin") {
+        return false;
+    }
+
+    // A macro would expand over the substituted argument forms.
+    Expr cell = global_binding(optimizer, CAR(expr));
+    if (!nil_p(cell) && macro_p(CDR(cell))) {
+        return false;
+    }
+
+    for (Expr xs = expr; cons_p(xs); xs = CDR(xs)) {
+        if (!inlinable_expr_p(optimizer, CAR(xs), self)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Index of a parameter in `vars`, or -1.
+static long int parameter_index(Expr vars, Expr name)
+{
+    for (long int i = 0; cons_p(vars); vars = CDR(vars), ++i) {
+        if (CAR(vars).atom->sym == name.atom->sym) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+* Checks that every name the body looks up (other than the parameters) means
+    the same thing at the call site as it did where the function was defined.
+*/
+static bool free_names_resolve_globally(const Optimizer& optimizer, Expr expr, Expr vars)
+{
+    if (symbol_p(expr)) {
+        if (parameter_index(vars, expr) >= 0) {
+            return true;
+        }
+
+        return !locally_bound_p(optimizer, expr)
+            && get_scope_value(optimizer.scope, expr).cons
+               == get_global_scope_value(optimizer.scope, expr).cons;
+    }
+
+    if (!cons_p(expr) || (symbol_p(CAR(expr)) && CAR(expr).atom->sym == "quote")) {
+        return true;
+    }
+
+    for (Expr xs = expr; cons_p(xs); xs = CDR(xs)) {
+        if (!free_names_resolve_globally(optimizer, CAR(xs), vars)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// What evaluating an inlined body does, in order: reads of a parameter and calls.
+struct InlineEvent {
+    long int parameter;     // index of the parameter read, or -1 for a call
+    bool conditional;       // inside the body of a `when`
+};
+
+/*
+* Lists the parameter reads and calls of a body in the order eval performs them:
+    the elements of a form from left to right, then the call itself. Any call may have
+    side effects or fail, even one to a pure native.
+*/
+static void trace_evaluation(Expr expr, Expr vars, bool conditional, std::vector<InlineEvent>& events)
+{
+    if (symbol_p(expr)) {
+        const long int index = parameter_index(vars, expr);
+        if (index >= 0) {
+            events.push_back(InlineEvent {index, conditional});
+        }
+        return;
+    }
+
+    if (!cons_p(expr)) {
+        return;
+    }
+
+    const std::string& name = CAR(expr).atom->sym;
+    if (name == "quote") {
+        return;
+    }
+
+    if (name == "begin" || name == "when") {
+        bool body = false;
+        for (Expr xs = CDR(expr); cons_p(xs); xs = CDR(xs)) {
+            trace_evaluation(CAR(xs), vars, conditional || body, events);
+            body = name == "when";
+        }
+        return;
+    }
+
+    for (Expr xs = expr; cons_p(xs); xs = CDR(xs)) {
+        trace_evaluation(CAR(xs), vars, conditional, events);
+    }
+
+    events.push_back(InlineEvent {-1, conditional});
+}
+
+// Replaces the parameters in `vars` by the matching expressions in `args`.
+static Expr substitute(Gc* gc, Expr expr, Expr vars, Expr args)
+{
+    if (symbol_p(expr)) {
+        for (; cons_p(vars); vars = CDR(vars), args = CDR(args)) {
+            if (CAR(vars).atom->sym == expr.atom->sym) {
+                return CAR(args);
+            }
+        }
+        return expr;
+    }
+
+    if (!cons_p(expr) || (symbol_p(CAR(expr)) && CAR(expr).atom->sym == "quote")) {
+        return expr;
+    }
+
+    return CONS(gc,
+                substitute(gc, CAR(expr), vars, args),
+                substitute(gc, CDR(expr), vars, args));
+}
+
+/*
+* Tries to inline a call to `callee` with already optimized `args`.
+    Returns void_expr() if the call has to stay a call.
+*/
+static Expr inline_call(Optimizer& optimizer, Expr head, Atom* callee, Expr args)
+{
+    const Lambda& lambda = callee->lambda;
+
+    if (optimizer.inline_depth >= INLINE_MAX_DEPTH
+        || !cons_p(lambda.envir) || !nil_p(CDR(lambda.envir))
+        || !cons_p(lambda.body) || !nil_p(CDR(lambda.body))
+        || !list_p(args) || length_of_list(args) != length_of_list(lambda.args_list)) {
+        return void_expr();
+    }
+
+    Expr body = CAR(lambda.body);
+
+    if (count_nodes(body, INLINE_MAX_NODES) > INLINE_MAX_NODES
+        || !inlinable_expr_p(optimizer, body, head)
+        || !free_names_resolve_globally(optimizer, body, lambda.args_list)) {
+        return void_expr();
+    }
+
+    // Constants may be read any number of times, anywhere; the other arguments are checked.
+    std::vector<bool> checked;
+    std::vector<bool> variable;
+    for (Expr xs = args; cons_p(xs); xs = CDR(xs)) {
+        Expr value = void_expr();
+        checked.push_back(!constant_p(optimizer, CAR(xs), &value));
+        variable.push_back(symbol_p(CAR(xs)));
+    }
+
+    std::vector<InlineEvent> events;
+    trace_evaluation(body, lambda.args_list, false, events);
+
+    std::vector<long int> reads(checked.size(), 0);
+    size_t expected = 0;
+    bool called = false;
+
+    for (const InlineEvent& event : events) {
+        if (event.parameter < 0) {
+            called = true;
+            continue;
+        }
+
+        const size_t index = event.parameter;
+        if (!checked[index]) {
+            continue;
+        }
+
+        if (called || event.conditional) {
+            return void_expr();
+        }
+
+        if (reads[index]++ == 0) {
+            while (expected < checked.size() && !checked[expected]) {
+                expected++;
+            }
+            if (index != expected++) {
+                return void_expr();
+            }
+        } else if (!variable[index]) {
+            return void_expr();
+        }
+    }
+
+    for (size_t i = 0; i < checked.size(); ++i) {
+        if (checked[i] && reads[i] == 0) {
+            return void_expr();
+        }
+    }
+
+    optimizer.inline_depth++;
+    Expr inlined = optimize_expr(optimizer, substitute(optimizer.gc, body, lambda.args_list, args));
+    optimizer.inline_depth--;
+
+    return inlined;
+}
+
+/*
+* A call to a pure native with constant arguments is evaluated right away.
+    If the native reports an error the call is left alone, so the error still happens at run time.
+*/
+static Expr optimize_call(Optimizer& optimizer, Expr form, Atom* native)
+{
+    Gc* gc = optimizer.gc;
+    Expr args = optimize_list(optimizer, CDR(form));
+
+    if (native->type == ATOM_LAMBDA) {
+        Expr inlined = inline_call(optimizer, CAR(form), native, args);
+        return inlined.type == EXPR_VOID ? CONS(gc, CAR(form), args) : inlined;
+    }
+
+    if (native->type != ATOM_NATIVE || !native->native.pure || !list_p(args)) {
+        return CONS(gc, CAR(form), args);
+    }
+
+    Expr values = NIL(gc);
+    Expr* tail = &values;
+    for (Expr arg = args; !nil_p(arg); arg = CDR(arg)) {
+        Expr value = void_expr();
+        if (!constant_p(optimizer, CAR(arg), &value)) {
+            return CONS(gc, CAR(form), args);
+        }
+
+        *tail = CONS(gc, value, NIL(gc));
+        tail = &tail->cons->cdr;
+    }
+
+    EvalResult result = native->native.fun(native->native.param, gc, optimizer.scope, values);
+    if (result.is_error) {
+        return CONS(gc, CAR(form), args);
+    }
+
+    return constant_as_expr(gc, result.expr);
+}
+
+// Rewrites a single expression of a lambda body.
+static Expr optimize_expr(Optimizer& optimizer, Expr expr)
+{
+    Gc* gc = optimizer.gc;
+
+    if (symbol_p(expr)) {
+        Expr cell = global_binding(optimizer, expr);
+        if (!nil_p(cell)
+            && gc->constants.count(expr.atom->sym) > 0
+            && self_evaluating_p(CDR(cell))) {
+            return CDR(cell);
+        }
+
+        return expr;
+    }
+
+    if (!cons_p(expr) || !symbol_p(CAR(expr)) || locally_bound_p(optimizer, CAR(expr))) {
+        return expr;
+    }
+
+    const std::string& name = CAR(expr).atom->sym;
+
+    if (name == "quote") {
+        Expr value = void_expr();
+        return constant_p(optimizer, expr, &value) && self_evaluating_p(value) ? value : expr;
+    }
+
+    if (name == "when") {
+        return optimize_when(optimizer, expr);
+    }
+
+    if (name == "begin") {
+        return CONS(gc, CAR(expr), optimize_list(optimizer, CDR(expr)));
+    }
+
+    if (is_special(name)) {
+        return expr;
+    }
+
+    // Only descend into calls of known functions: the arguments of a macro
+    // or of a function defined later are not necessarily expressions.
+    Expr cell = global_binding(optimizer, CAR(expr));
+    if (nil_p(cell) || CDR(cell).type != EXPR_ATOM) {
+        return expr;
+    }
+
+    Atom* callee = CDR(cell).atom;
+    if (callee->type != ATOM_NATIVE && callee->type != ATOM_LAMBDA) {
+        return expr;
+    }
+
+    return optimize_call(optimizer, expr, callee);
+}
+
+/*
+* Escape analysis of a call frame: a closure or macro created in the body captures it,
+    `scope` returns it and `load` evaluates arbitrary code in it; a macro call is unknown code.
+    Names are matched anywhere in the body, quoted or not, which is conservative.
+    A capture this misses (e.g. a macro passed in as an argument) is still caught at runtime
+    by scope_escape, so the analysis only has to be right about the common case.
+*/
+static bool may_capture_frame(const Optimizer& optimizer, Expr expr)
+{
+    static const std::string capturing[] = {"defmacro", "defun", "lambda", "load", "scope", "λ"};
+
+    if (symbol_p(expr)) {
+        return std::binary_search(std::begin(capturing), std::end(capturing), expr.atom->sym);
+    }
+
+    if (!cons_p(expr)) {
+        return false;
+    }
+
+    if (symbol_p(CAR(expr)) && !locally_bound_p(optimizer, CAR(expr))) {
+        Expr cell = global_binding(optimizer, CAR(expr));
+        if (!nil_p(cell) && macro_p(CDR(cell))) {
+            return true;
+        }
+    }
+
+    for (; cons_p(expr); expr = CDR(expr)) {
+        if (may_capture_frame(optimizer, CAR(expr))) {
+            return true;
+        }
+    }
+
+    return may_capture_frame(optimizer, expr);
+}
+
+void optimize_lambda(Gc* gc, Atom* lambda)
+{
+    assert(gc);
+    assert(lambda);
+    assert(lambda->type == ATOM_LAMBDA);
+
+    Scope scope = {
+        .expr = lambda->lambda.envir
+    };
+
+    Optimizer optimizer = {
+        .gc = gc,
+        .scope = &scope,
+        .bound = {},
+        .inline_depth = 0
+    };
+
+    for (Expr vars = lambda->lambda.args_list; cons_p(vars); vars = CDR(vars)) {
+        optimizer.bound.push_back(CAR(vars));
+    }
+
+    lambda->lambda.optimized = gc_write_barrier(gc, lambda,
+                                                optimize_list(optimizer, lambda->lambda.body));
+    lambda->lambda.frame_escapes = may_capture_frame(optimizer, lambda->lambda.optimized);
+    lambda->lambda.epoch = gc->epoch;
+}
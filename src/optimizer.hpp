@@ -0,0 +1,17 @@
+#ifndef OPTIMIZER_H_
+#define OPTIMIZER_H_
+
+#pragma once
+
+#include "expr.hpp"
+#include "gc.hpp"
+#include "scope.hpp"
+
+/*
+* Rewrites the body of a lambda atom into lambda.optimized and stamps it
+    with the current Gc epoch. The original body is kept untouched, so a
+    stale optimization (the epoch moved on) is simply redone from it.
+*/
+void optimize_lambda(Gc* gc, Atom* lambda);
+
+#endif  // OPTIMIZER_H_
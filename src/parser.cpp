@@ -17,15 +17,16 @@
 #include <cerrno>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <string>
-#include <string_view>
+#include <vector>
 
 #include "builtins.hpp"
 #include "parser.hpp"
 
-#define MAX_BUFFER_LENGTH (5 * 1000 * 1000)
+#define MAX_BUFFER_LENGTH (256 * 1000 * 1000)
 
 static ParseResult parse_expr(Gc *gc, Token current_token);
 
@@ -41,7 +42,7 @@ static ParseResult parse_cdr(Gc *gc, Token current_token)
         return parse_failure("Expected .", current_token.begin);
     }
 
-    ParseResult cdr = read_expr_from_string(gc, std::string_view(current_token.end));
+    ParseResult cdr = parse_expr(gc, next_token(current_token.end));
     if (cdr.is_error) {
         return cdr;
     }
@@ -66,14 +67,13 @@ static ParseResult parse_list_end(Gc *gc, Token current_token)
         return parse_failure("Expected )", current_token.begin);
     }
 
-    return parse_success(atom_as_expr(create_symbol_atom(gc, "nil", nullptr)),
-                         current_token.end);
+    return parse_success(NIL(gc), current_token.end);
 }
 
 /*
 * Parses a sequence of Lisp expressions enclosed in parentheses, treating it as a list.
-* Recursively constructs the internal structure of the list by creating cons cells for each expression parsed,
-  until it encounters either a dot (for cdr notation) or the closing parenthesis.
+* Collects the expressions parsed until it encounters either a dot (for cdr notation) or the closing parenthesis,
+  then builds the list in one go so that its cons cells are adjacent (see list_from_array).
 * Deals with proper list structures (`(a b c)`) as well as dotted pairs (`(a . b)`).
 * Returns a `ParseResult` containing the fully constructed list or an error in case of syntax violations.
 */
@@ -89,28 +89,19 @@ static ParseResult parse_list(Gc *gc, Token current_token)
         return parse_list_end(gc, current_token);
     }
 
-    ParseResult car = parse_expr(gc, current_token);
-    if (car.is_error) {
-        return car;
-    }
-
-    Cons *list = create_cons(gc, car.expr, void_expr());
-    Cons *cons = list;
-    current_token = next_token(car.end);
+    std::vector<Expr> items;
 
-    while (current_token.begin[0] != '.' &&
-           current_token.begin[0] != ')' &&
-           current_token.begin[0] != 0) {
-        car = parse_expr(gc, current_token);
+    do {
+        ParseResult car = parse_expr(gc, current_token);
         if (car.is_error) {
             return car;
         }
 
-        cons->cdr = cons_as_expr(create_cons(gc, car.expr, void_expr()));
-        cons = cons->cdr.cons;
-
+        items.push_back(car.expr);
         current_token = next_token(car.end);
-    }
+    } while (current_token.begin[0] != '.' &&
+             current_token.begin[0] != ')' &&
+             current_token.begin[0] != 0);
 
     ParseResult cdr = (current_token.begin[0] == '.')
         ? parse_cdr(gc, current_token)
@@ -120,9 +111,7 @@ static ParseResult parse_list(Gc *gc, Token current_token)
         return cdr;
     }
 
-    cons->cdr = cdr.expr;
-
-    return parse_success(cons_as_expr(list), cdr.end);
+    return parse_success(list_from_array(gc, items.data(), items.size(), cdr.expr), cdr.end);
 }
 
 
@@ -171,7 +160,7 @@ static ParseResult parse_string(Gc* gc, Token current_token)
         }
         else if (*c == '"') {
             return parse_success(
-                atom_as_expr(create_string_atom(gc, str.c_str(), nullptr)),
+                atom_as_expr(create_string_atom(gc, str.data(), str.data() + str.size())),
                 c + 1);
         }
         else {
@@ -191,7 +180,7 @@ static ParseResult parse_string(Gc* gc, Token current_token)
 */
 static ParseResult parse_integer(Gc *gc, Token current_token)
 {
-    std::string endptr = nullptr;
+    char* endptr = nullptr;
     const long int x = std::strtol(current_token.begin, &endptr, 10);
 
     if ((current_token.begin == endptr) || (current_token.end != endptr)) {
@@ -213,7 +202,7 @@ static ParseResult parse_real(Gc *gc, Token current_token)
 {
     assert(gc);
 
-    std::string endptr = nullptr;
+    char* endptr = nullptr;
     const float x = std::strtof(current_token.begin, &endptr);
 
     if ((current_token.begin == endptr) || (current_token.end != endptr)) {
@@ -320,12 +309,12 @@ static ParseResult parse_expr(Gc *gc, Token current_token)
 * Primarily used for handling simple inputs or evaluating expressions from user input 
     or files at a single-expression granularity.
 
-* Ensures basic preconditions (non-emptiness of the string) before dispatching to the parsing logic.
+* The string is parsed in place: tokens and the resulting `end` are cursors into it.
 */
-ParseResult read_expr_from_string(Gc *gc, const std::string& str)
+ParseResult read_expr_from_string(Gc *gc, const char* str)
 {
     assert(gc);
-    assert(!str.empty());
+    assert(str);
     return parse_expr(gc, next_token(str));
 }
 
@@ -335,13 +324,13 @@ ParseResult read_expr_from_string(Gc *gc, const std::string& str)
 * Accommodates for multiple expressions separated by standard Lisp delimiters, enabling batch processing of Lisp code.
 * Returns a `ParseResult` containing a list of all parsed expressions or an error if any part of the string violates Lisp syntax.
 */
-ParseResult read_all_exprs_from_string(Gc *gc, const std::string& str)
+ParseResult read_all_exprs_from_string(Gc *gc, const char* str)
 {
     assert(gc);
-    assert(!str.empty());
+    assert(str);
 
     Token current_token = next_token(str);
-    if (*(current_token.end) == 0) {
+    if (*(current_token.begin) == 0) {
         return parse_success(NIL(gc), current_token.end);
     }
 
@@ -354,8 +343,8 @@ ParseResult read_all_exprs_from_string(Gc *gc, const std::string& str)
     Cons *cons = head;
 
     current_token = next_token(parse_result.end);
-    while (*(current_token.end) != 0) {
-        parse_result = parse_expr(gc, current_token.begin);
+    while (*(current_token.begin) != 0) {
+        parse_result = parse_expr(gc, current_token);
         if (parse_result.is_error) {
             return parse_result;
         }
@@ -376,15 +365,9 @@ ParseResult read_all_exprs_from_string(Gc *gc, const std::string& str)
 * Utilizes the errno value to retrieve a human-readable error message using `std::strerror`.
 * Intended for use in situations where an I/O operation fails, offering a mechanism to signal I/O related errors during parsing.
 */
-ParseResult parse_io_failure(int errno)
+ParseResult parse_io_failure(int error_code)
 {
-    ParseResult result = {
-        .is_error = true,
-        .error_message = std::strerror(errno),
-        .end = nullptr
-    };
-
-    return result;
+    return parse_failure(std::strerror(error_code), nullptr);
 }
 
 
@@ -430,7 +413,7 @@ ParseResult read_expr_from_file(Gc *gc, const std::string& filename)
     std::string buffer(buffer_length, ' ');
     stream.read(&buffer[0], buffer_length);
 
-    ParseResult result = read_expr_from_string(gc, buffer);
+    ParseResult result = read_expr_from_string(gc, buffer.c_str());
 
     return result;
 }
@@ -475,7 +458,7 @@ ParseResult read_all_exprs_from_file(Gc *gc, const std::string& filename)
     std::string buffer(buffer_length, ' ');
     stream.read(&buffer[0], buffer_length);
 
-    ParseResult result = read_all_exprs_from_string(gc, buffer);
+    ParseResult result = read_all_exprs_from_string(gc, buffer.c_str());
 
     return result;
 }
@@ -492,12 +475,12 @@ ParseResult read_all_exprs_from_file(Gc *gc, const std::string& filename)
 * This function is used to encapsulate a successful parsing outcome, 
     providing a uniform interface for handling parse results.
 */
-ParseResult parse_success(Expr expr, const std::string& end)
+ParseResult parse_success(Expr expr, const char* end)
 {
     ParseResult result = {
         .is_error = false,
-        .expr = expr,
-        .end = end
+        .end = end,
+        .expr = expr
     };
 
     return result;
@@ -514,12 +497,12 @@ ParseResult parse_success(Expr expr, const std::string& end)
 
 * Allows for a consistent method of signaling parsing errors across the parsing subsystem.
 */
-ParseResult parse_failure(const std::string& error_message, const std::string& end)
+ParseResult parse_failure(const char* error_message, const char* end)
 {
     ParseResult result = {
         .is_error = true,
-        .error_message = error_message,
-        .end = end
+        .end = end,
+        .error_message = error_message
     };
 
     return result;
@@ -557,7 +540,7 @@ static std::string trim_whitespace(const std::string& str) {
 * Designed to provide detailed feedback on parsing errors, facilitating debugging and error correction.
 */
 
-void print_parse_error(FILE* stream, const std::string& str, ParseResult result)
+void print_parse_error(FILE* stream, const char* str, ParseResult result)
 {
     if (!result.is_error) {
         return;
@@ -567,7 +550,7 @@ void print_parse_error(FILE* stream, const std::string& str, ParseResult result)
     size_t column_number = 1;
     size_t current_column = 1;
 
-    for (const char* c = str.c_str(); c < result.end; ++c) {
+    for (const char* c = str; c < result.end; ++c) {
         if (*c == '\n') {
             line_number++;
             column_number = current_column;
@@ -580,7 +563,7 @@ void print_parse_error(FILE* stream, const std::string& str, ParseResult result)
     fprintf(stream, "Parse error at line %zu, column %zu:\n", line_number, column_number);
 
     if (result.end) {
-        std::string trimmed_str = trim_whitespace(std::string(str.begin(), result.end));
+        std::string trimmed_str = trim_whitespace(std::string(str, result.end));
         size_t line_length = trimmed_str.size();
 
         for (size_t i = 0; i < line_number - 1; ++i) {
@@ -601,7 +584,7 @@ void print_parse_error(FILE* stream, const std::string& str, ParseResult result)
         fprintf(stream, "^\n");
     }
 
-    fprintf(stream, "%s\n", result.error_message.c_str());
+    fprintf(stream, "%s\n", result.error_message);
 }
 
 
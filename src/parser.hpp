@@ -15,20 +15,20 @@ struct ParseError : public std::runtime_error {
 };
 */
 
+/*
+* The parser never copies the input. All positions are cursors into the one
+    immutable, NUL-terminated buffer handed to read_*_from_string,
+    so `end` is where parsing stopped on success and where the error was
+    detected on failure. Error messages are static strings.
+*/
 struct ParseResult
 {
     bool is_error;
-    const std::string end;
+    const char* end;
     union {
         Expr expr;
-        const std::string error_message;
+        const char* error_message;
     };
-
-    ParseResult(bool is_error_, const std::string end_, const Expr& expr_)
-        : is_error(is_error_), end(end_), expr(expr_) {}
-
-    ParseResult(bool is_error_, const std::string end_, const std::string& error_message_)
-        : is_error(is_error_), end(end_), error_message(error_message_) {}
 };
 
 static ParseResult parse_cdr(Gc* gc, Token current_token);
@@ -40,17 +40,17 @@ static ParseResult parse_real(Gc* gc, Token current_token);
 static ParseResult parse_symbol(Gc* gc, Token current_token);
 static ParseResult parse_expr(Gc* gc, Token current_token);
 
-ParseResult parse_success(Expr expr, const std::string& end);
-ParseResult parse_failure(const std::string& error_message, const std::string& end);
+ParseResult parse_success(Expr expr, const char* end);
+ParseResult parse_failure(const char* error_message, const char* end);
 
-ParseResult read_expr_from_string(Gc* gc, const std::string& str);
-ParseResult read_all_exprs_from_string(Gc* gc, const std::string& str);
+ParseResult read_expr_from_string(Gc* gc, const char* str);
+ParseResult read_all_exprs_from_string(Gc* gc, const char* str);
 
 ParseResult read_expr_from_file(Gc* gc, const std::string& filename);
 ParseResult read_all_exprs_from_file(Gc* gc, const std::string& filename);
 
 void print_parse_error(FILE* stream,
-    const std::string& str,
+    const char* str,
     ParseResult result);
 
 #endif  // PARSER_H_
@@ -10,6 +10,7 @@
 #pragma once
 
 #include <cassert>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -39,6 +40,71 @@ static EvalResult gcInspectAdapter(void *param, Gc *_gc, Scope *_scope, Expr arg
     return eval_success(NIL(_gc));
 }
 
+/*
+* Returns, per kind of object, how many the heap holds and how many bytes they take:
+    ((cons count bytes) (symbol count bytes) ...). Kinds with no objects are left out.
+    A last (large-objects count bytes) entry gives the mappings of big string payloads,
+    which are also part of the bytes of their strings.
+*/
+static EvalResult heapCensus(void *param, Gc *_gc, Scope *_scope, Expr args)
+{
+    assert(_gc);
+    assert(_scope);
+    (void) param;
+    (void) args;
+
+    const HeapCensus census = gc_census(_gc);
+    Expr result = NIL(_gc);
+
+    if (census.large_objects > 0) {
+        result = CONS(_gc,
+                      CONS(_gc, SYMBOL(_gc, "large-objects"),
+                           CONS(_gc, INTEGER(_gc, census.large_objects),
+                                CONS(_gc, INTEGER(_gc, census.large_bytes), NIL(_gc)))),
+                      result);
+    }
+
+    for (size_t kind = HEAP_KINDS; kind-- > 0;) {
+        if (census.counts[kind] == 0) {
+            continue;
+        }
+
+        result = CONS(_gc,
+                      CONS(_gc, SYMBOL(_gc, heap_kind_name(kind)),
+                           CONS(_gc, INTEGER(_gc, census.counts[kind]),
+                                CONS(_gc, INTEGER(_gc, census.bytes[kind]), NIL(_gc)))),
+                      result);
+    }
+
+    return eval_success(result);
+}
+
+/*
+* Writes the object graph to a file for tools/heap-summary.cpp (format in gc_dump).
+    Retainer paths start at the bindings of the global scope.
+*/
+static EvalResult heapDump(void *param, Gc *_gc, Scope *_scope, Expr args)
+{
+    assert(_gc);
+    assert(_scope);
+    (void) param;
+
+    const std::string&filename = nullptr;
+    EvalResult result = match_list(_gc, "s", args, &filename);
+    if (result.is_error) {
+        return result;
+    }
+
+    std::ofstream out(filename);
+    if (!out) {
+        return eval_failure(list(_gc, "qs", "file-error", filename.c_str()));
+    }
+
+    gc_dump(_gc, _scope->expr, out);
+
+    return eval_success(T(_gc));
+}
+
 /*
 * Introduces a native function that allows the program to exit gracefully when invoked. 
     This function can be called from within the Lisp environment to terminate the REPL session.
@@ -66,6 +132,7 @@ static EvalResult getScope(void *param, Gc *_gc, Scope *_scope, Expr args)
     (void) param;
     (void) args;
 
+    scope_escape(_gc, _scope);
     return eval_success(_scope->expr);
 }
 
@@ -103,6 +170,8 @@ void load_repl_runtime(Gc *_gc, Scope *_scope)
 
     set_scope_value(gc, scope, SYMBOL(gc, "quit"), NATIVE(gc, quit, nullptr));
     set_scope_value(gc, scope, SYMBOL(gc, "gc-inspect"), NATIVE(gc, gcInspectAdapter, nullptr));
+    set_scope_value(gc, scope, SYMBOL(gc, "heap-census"), NATIVE(gc, heapCensus, nullptr));
+    set_scope_value(gc, scope, SYMBOL(gc, "heap-dump"), NATIVE(gc, heapDump, nullptr));
     set_scope_value(gc, scope, SYMBOL(gc, "scope"), NATIVE(gc, getScope, nullptr));
     set_scope_value(gc, scope, SYMBOL(gc, "print"), NATIVE(gc, print, nullptr));
 }
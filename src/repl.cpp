@@ -16,11 +16,13 @@ a complete program or compile and run it.
 
 #pragma once
 
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "aot.hpp"
 #include "gc.hpp"
 #include "interpreter.hpp"
 #include "parser.hpp"
@@ -36,29 +38,33 @@ constexpr size_t REPL_BUFFER_MAX = 1024;
     
     If an error occurs, it prints an error message and returns. 
 */
-static void eval_line(Gc &gc, Scope &scope, const std::string&&line)
+static void eval_line(Gc &gc, Scope &scope, const std::string &line)
 {
-    while (!line.empty()) {
+    const char *cursor = line.c_str();
+
+    while (*cursor != 0) {
         gc.collect();
         //Parse.
-        auto parse_result = read_expr_from_string(gc, line);
+        auto parse_result = read_expr_from_string(gc, cursor);
         if (parse_result.is_error) {
             print_parse_error(std::cerr, line.c_str(), parse_result);
             return;
         }
         //Evaluate.
-        auto eval_result = eval(gc, scope, parse_result.expr);
+        auto eval_result = eval_top_level(gc, scope, parse_result.expr);
         if (eval_result.is_error) {
             std::cerr << "Error:\t";
             print_expr_as_sexpr(std::cerr, eval_result.expr);
             std::cerr << std::endl;
+            // Give back what an aborted form (e.g. memory-exhausted) left behind right away.
+            gc.collect();
             return;
         }
         //Print in human-readable form.
         print_expr_as_sexpr(std::cerr, eval_result.expr);
         std::cout << std::endl;
 
-        line = next_token(parse_result.end).begin;
+        cursor = next_token(parse_result.end).begin;
     }
 }
 
@@ -67,6 +73,17 @@ static void eval_line(Gc &gc, Scope &scope, const std::string&&line)
 * Main is responsible for initializing the necessary components,
 * starting the REPL loop, 
 * and handling any errors that may occur during execution.
+
+* Options may be combined, `--aot` has to be the last one.
+* `--aot out.cpp file...` translates the files to C++ instead of starting the REPL (see aot.cpp).
+* `--max-eval-depth n` changes how deep calls may nest before stack-overflow.
+* `--max-steps n` and `--timeout-ms n` bound every top-level form (fuel-exhausted, timeout).
+* `--heap-limit n` and `--allocation-quota n` bound memory, in bytes (memory-exhausted).
+    The heap is only swept between forms, so `--heap-limit` bounds what survived earlier
+    forms plus all a form allocates, garbage included.
+* `--request-region` frees what each line allocates as soon as it has been evaluated
+    (see gc_begin_request); only the value and new global bindings are kept.
+* `--huge-pages` lets densely used heap chunks be backed by transparent huge pages.
 */
 
 int main(int argc, std::string argv[])
@@ -77,6 +94,35 @@ int main(int argc, std::string argv[])
     load_std_library(*gc, &scope);
     load_repl_runtime(*gc, &scope);
 
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+
+        if (has_value && argv[i] == "--max-eval-depth") {
+            gc->max_eval_depth = std::stoul(argv[++i]);
+        } else if (has_value && argv[i] == "--max-steps") {
+            gc->step_limit = std::stoul(argv[++i]);
+        } else if (has_value && argv[i] == "--timeout-ms") {
+            gc->time_limit_ms = std::stoul(argv[++i]);
+        } else if (has_value && argv[i] == "--heap-limit") {
+            gc->heap_limit = std::stoul(argv[++i]);
+        } else if (has_value && argv[i] == "--allocation-quota") {
+            gc->allocation_quota = std::stoul(argv[++i]);
+        } else if (argv[i] == "--huge-pages") {
+            gc->heap.huge_pages = true;
+        } else if (argv[i] == "--request-region") {
+            gc->request_per_form = true;
+        } else if (has_value && argv[i] == "--aot") {
+            // The rest of the command line are the files to translate.
+            std::ofstream out(argv[i + 1]);
+            std::vector<std::string> filenames(argv + i + 2, argv + argc);
+
+            return aot_compile_files(*gc, &scope, filenames, out, std::cerr) ? 0 : 1;
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
     while (true) {
         std::cout >> "> ";
 
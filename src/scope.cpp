@@ -3,6 +3,10 @@
 #pragma once
 
 #include <assert.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
 #include "scope.hpp"
 
 /*
@@ -28,6 +32,36 @@ Expr get_scope_value(const Scope *scope, Expr name)
     return get_scope_value_impl(scope->expr, name);
 }
 
+// Retrieves the value cell of a name from the outermost (global) frame only,
+// ignoring any local frame that might shadow it.
+Expr get_global_scope_value(const Scope *scope, Expr name)
+{
+    Expr frames = scope->expr;
+
+    while (cons_p(frames) && cons_p(frames.cons->cdr)) {
+        frames = frames.cons->cdr;
+    }
+
+    return cons_p(frames) ? assoc(name, frames.cons->car) : frames;
+}
+
+// Optimized lambda bodies assume the global functions and constants they saw
+// stay the same (see optimizer.cpp). Rebinding one of them invalidates them all.
+static bool invalidates_optimizations(Gc *gc, Expr value_cell)
+{
+    Expr name = value_cell.cons->car;
+    Expr old_value = value_cell.cons->cdr;
+
+    if (old_value.type == EXPR_ATOM
+        && (old_value.atom->type == ATOM_NATIVE
+            || old_value.atom->type == ATOM_LAMBDA
+            || old_value.atom->type == ATOM_MACRO)) {
+        return true;
+    }
+
+    return symbol_p(name) && gc->constants.count(name.atom->sym) > 0;
+}
+
 // Internal function to set or update the value associated with a given name within the scope, 
 // handling scope nesting and global scope mutations as needed.
 Expr set_scope_value_impl(Gc *gc, Expr &scope, Expr name, Expr value)
@@ -37,14 +71,19 @@ Expr set_scope_value_impl(Gc *gc, Expr &scope, Expr name, Expr value)
 
         if (!nil_p(value_cell)) {
             /* A binding already exists, mutate it */
-            value_cell.cons->cdr = value;
+            if (nil_p(scope.cons->cdr) && invalidates_optimizations(gc, value_cell)) {
+                gc->epoch++;
+            }
+
+            value_cell.cons->cdr = gc_write_barrier(gc, value_cell.cons, value);
 
             return scope;
         } else if (nil_p(scope.cons->cdr)) {
             /* We're at the global scope, add a binding, preserving
              * the identity of the environment list "spine" so that
              * closed-over environments see the new value cell */
-            scope.cons->car = CONS(gc, CONS(gc, name, value), scope.cons->car);
+            scope.cons->car = gc_write_barrier(gc, scope.cons,
+                                               CONS(gc, CONS(gc, name, value), scope.cons->car));
 
             return scope;
         } else {
@@ -99,6 +138,25 @@ void push_scope_frame(Gc *gc, Scope *scope, Expr vars, Expr args)
     scope->expr = CONS(gc, frame, scope->expr);
 }
 
+// Same as push_scope_frame, but the frame is allocated in the region (gc->frames)
+// and disappears when the call that pushed it releases the region.
+void push_region_scope_frame(Gc *gc, Scope *scope, Expr vars, Expr args)
+{
+    assert(gc);
+    assert(scope);
+
+    Expr frame = NIL(gc);
+
+    while (!nil_p(vars) && !nil_p(args)) {
+        Cons *binding = region_cons(gc, vars.cons->car, args.cons->car);
+        frame = cons_as_expr(region_cons(gc, cons_as_expr(binding), frame));
+        vars = vars.cons->cdr;
+        args = args.cons->cdr;
+    }
+
+    scope->expr = cons_as_expr(region_cons(gc, frame, scope->expr));
+}
+
 // Removes the topmost scope frame from the given scope structure, 
 // effectively ending the scope frame's lifetime and its variable bindings.
 void pop_scope_frame(Gc *gc, Scope *scope)
@@ -111,4 +169,154 @@ void pop_scope_frame(Gc *gc, Scope *scope)
     }
 }
 
+// Adds a binding to the topmost frame of a scope, in front of any binding of the same name,
+// and returns its value cell.
+Expr bind_in_scope_frame(Gc *gc, Scope *scope, Expr name, Expr value)
+{
+    assert(gc);
+    assert(cons_p(scope->expr));
+
+    Expr cell = CONS(gc, name, value);
+    scope->expr.cons->car = CONS(gc, cell, scope->expr.cons->car);
+
+    return cell;
+}
+
+// Number of frames on the scope stack, the global frame included.
+size_t scope_depth(const Scope *scope)
+{
+    size_t depth = 0;
+
+    for (Expr spine = scope->expr; cons_p(spine); spine = spine.cons->cdr) {
+        depth++;
+    }
+
+    return depth;
+}
+
+static Expr copy_region_frame(Gc *gc, Expr frame)
+{
+    Expr copy = NIL(gc);
+    Expr *tail = &copy;
+
+    for (; cons_p(frame); frame = frame.cons->cdr) {
+        Expr binding = frame.cons->car;
+        *tail = CONS(gc, CONS(gc, binding.cons->car, binding.cons->cdr), NIL(gc));
+        tail = &tail->cons->cdr;
+    }
+
+    return copy;
+}
+
+/*
+* Moves the region-allocated frames of a scope to the heap.
+    Called right before something keeps the scope beyond the current call
+    (a closure, a macro, `scope`). The running call continues on the copies,
+    so a later `set` of a parameter is seen by the closure as well.
+*/
+void scope_escape(Gc *gc, Scope *scope)
+{
+    std::vector<Expr> spine;
+    size_t region_depth = 0;
+
+    for (Expr rest = scope->expr; cons_p(rest); rest = rest.cons->cdr) {
+        spine.push_back(rest);
+        if (region_owns(gc, rest.cons)) {
+            region_depth = spine.size();
+        }
+    }
+
+    if (region_depth == 0) {
+        return;
+    }
+
+    Expr copy = spine[region_depth - 1].cons->cdr;
+
+    for (size_t i = region_depth; i-- > 0;) {
+        Expr frame = spine[i].cons->car;
+        if (cons_p(frame) && region_owns(gc, frame.cons)) {
+            frame = copy_region_frame(gc, frame);
+        }
+        copy = CONS(gc, frame, copy);
+    }
+
+    scope->expr = copy;
+}
+
+/*
+* Collects the names a lambda body mentions, except its own parameters.
+    Returns false if the body can reach bindings it doesn't mention:
+    a macro call expands to unknown code, `load` and `scope` see the whole scope.
+*/
+static bool collect_mentioned_names(const Scope *scope,
+                                    Expr expr,
+                                    std::unordered_set<std::string> &names)
+{
+    if (symbol_p(expr)) {
+        if (expr.atom->sym == "load" || expr.atom->sym == "scope") {
+            return false;
+        }
+        names.insert(expr.atom->sym);
+        return true;
+    }
+
+    if (!cons_p(expr)) {
+        return true;
+    }
+
+    if (symbol_p(expr.cons->car)) {
+        Expr cell = get_scope_value(scope, expr.cons->car);
+        if (!nil_p(cell) && macro_p(cell.cons->cdr)) {
+            return false;
+        }
+    }
+
+    for (; cons_p(expr); expr = expr.cons->cdr) {
+        if (!collect_mentioned_names(scope, expr.cons->car, names)) {
+            return false;
+        }
+    }
+
+    return collect_mentioned_names(scope, expr, names);
+}
+
+/*
+* Builds the environment a closure keeps (closure conversion).
+    Instead of the whole scope, it is a single frame holding the binding cells
+    of the enclosing local names the body mentions, followed by the global frame.
+    The cells are shared, not copied, so a `set` in the closure or in the enclosing
+    code is seen by both; every other local binding is no longer retained.
+*/
+Expr closure_scope(Gc *gc, const Scope *scope, Expr args, Expr body)
+{
+    Expr global = scope->expr;
+    while (cons_p(global) && cons_p(global.cons->cdr)) {
+        global = global.cons->cdr;
+    }
 
+    if (!cons_p(scope->expr) || scope->expr.cons == global.cons) {
+        return scope->expr;
+    }
+
+    std::unordered_set<std::string> names;
+    if (!collect_mentioned_names(scope, body, names)) {
+        return scope->expr;
+    }
+
+    for (Expr arg = args; cons_p(arg); arg = arg.cons->cdr) {
+        names.erase(arg.cons->car.atom->sym);
+    }
+
+    Expr frame = NIL(gc);
+
+    for (Expr spine = scope->expr; spine.cons != global.cons; spine = spine.cons->cdr) {
+        for (Expr bindings = spine.cons->car; cons_p(bindings); bindings = bindings.cons->cdr) {
+            Expr cell = bindings.cons->car;
+            if (names.erase(cell.cons->car.atom->sym) > 0) {
+                frame = CONS(gc, cell, frame);
+            }
+        }
+    }
+
+    return CONS(gc, frame, global);
+}
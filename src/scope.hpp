@@ -5,6 +5,7 @@
 
 #include "expr.hpp"
 #include "builtins.hpp"
+#include "gc.hpp"
 
 struct Scope
 {
@@ -19,8 +20,14 @@ struct Scope
 Scope create_scope(Gc* gc);
 
 Expr get_scope_value(const Scope* scope, Expr name);
+Expr get_global_scope_value(const Scope* scope, Expr name);
 void set_scope_value(Gc* gc, Scope* scope, Expr name, Expr value);
 void push_scope_frame(Gc* gc, Scope* scope, Expr vars, Expr args);
+void push_region_scope_frame(Gc* gc, Scope* scope, Expr vars, Expr args);
 void pop_scope_frame(Gc* gc, Scope* scope);
+Expr bind_in_scope_frame(Gc* gc, Scope* scope, Expr name, Expr value);
+size_t scope_depth(const Scope* scope);
+void scope_escape(Gc* gc, Scope* scope);
+Expr closure_scope(Gc* gc, const Scope* scope, Expr args, Expr body);
 
 #endif  // SCOPE_H_
@@ -1,10 +1,18 @@
 #pragma once
 
 #include <assert.h>
+#include <errno.h>
 #include <string.h>
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <system_error>
 #include <vector>
 
 #include "std.hpp"
+#include "aot.hpp"
 
 /*
 *Primary functionalities: 
@@ -45,6 +53,9 @@ struct RealFn {
 *  This structure creates a lambda function, 
     encapsulating a piece of code ("body") that can be executed later with 
     a given set of arguments ("args") within a specific lexical scope. 
+    
+    The body is run through the optimizer once here, so every call evaluates the folded version.
+    The lambda keeps only the bindings its body mentions (see closure_scope), not the whole scope.
 */
 struct LambdaFn {
     Gc* gc;
@@ -53,7 +64,10 @@ struct LambdaFn {
     Scope* scope;
 
     Expr operator()() {
-        return atom_as_expr(create_lambda_atom(gc, args, body, scope->expr));
+        scope_escape(gc, scope);
+        Atom* lambda = create_lambda_atom(gc, args, body, closure_scope(gc, scope, args, body));
+        optimize_lambda(gc, lambda);
+        return atom_as_expr(lambda);
     }
 };
 
@@ -65,6 +79,12 @@ struct LambdaFn {
   Example: (1 ,(+ 2 3) 4)
 */
 
+// Checks for `(unquote x)`, which is also what a dotted `. ,x` tail reads as.
+static bool unquote_form_p(Expr x) {
+    return cons_p(x) && symbol_p(CAR(x)) && CAR(x).atom->sym == "unquote"
+        && cons_p(CDR(x)) && nil_p(CDR(CDR(x)));
+}
+
 /*
 * Quasiquote expressions allow parts of a code list to be evaluated only when 
     the list itself is evaluated.
@@ -93,15 +113,23 @@ struct QuasiquoteFn {
             return eval(gc, scope, unquote_expr);
         }
         else if (cons_p(expr)) {
-            EvalResult left = quasiquote(*this, gc, scope, CONS(gc, CAR(expr), NIL(gc)));
-            if (left.is_error) {
-                return left;
+            // Quasiquote the elements up to a dotted `,x` or the end,
+            // then build the copy as one run of adjacent conses (see list_from_array).
+            std::vector<Expr> items;
+
+            for (; cons_p(expr) && !unquote_form_p(expr); expr = CDR(expr)) {
+                EvalResult item = (*this)(CONS(gc, CAR(expr), NIL(gc)));
+                if (item.is_error) {
+                    return item;
+                }
+                items.push_back(item.expr);
             }
-            EvalResult right = quasiquote(*this, gc, scope, CONS(gc, CDR(expr), NIL(gc)));
-            if (right.is_error) {
-                return right;
+
+            EvalResult tail = (*this)(CONS(gc, expr, NIL(gc)));
+            if (tail.is_error) {
+                return tail;
             }
-            return eval_success(CONS(gc, left.expr, right.expr));
+            return eval_success(list_from_array(gc, items.data(), items.size(), tail.expr));
         }
         else {
             return eval_success(expr);
@@ -137,7 +165,7 @@ struct GreaterThan2Fn {
 
     EvalResult operator()(Expr a, Expr b) {
         if (integer_p(a) && integer_p(b)) {
-            return eval_success(bool_as_expr(gc, a.atom->num > b.atom->num));
+            return eval_success(bool_as_expr(a.atom->num > b.atom->num));
         }
         else {
             EvalResult result_a = real(*this, gc, a);
@@ -147,7 +175,7 @@ struct GreaterThan2Fn {
             if (result_b.is_error) return result_b;
 
             return eval_success(
-                bool_as_expr(gc, result_a.expr.atom->real > result_b.expr.atom->real));
+                bool_as_expr(result_a.expr.atom->real > result_b.expr.atom->real));
         }
     }
 };
@@ -191,7 +219,7 @@ struct GreaterThanFn {
             x1 = x2;
         }
 
-        return eval_success(bool_as_expr(gc, sorted));
+        return eval_success(bool_as_expr(sorted));
     }
 };
 
@@ -466,6 +494,82 @@ struct DefunFn {
     }
 };
 
+/*
+* Defines a new macro within the current scope: (defmacro name (args...) body...).
+* A macro call receives its arguments unevaluated and the expression it returns is evaluated
+    in place of the call. Each call site is expanded once and the expansion is cached
+    (see expand_macro), so the abstraction costs nothing after the first evaluation.
+*/
+struct DefmacroFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr name = void_expr();
+        Expr args_list = void_expr();
+        Expr body = void_expr();
+
+        EvalResult result = match_list(gc, "ee*", args, &name, &args_list, &body);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!symbol_p(name)) {
+            return wrong_argument_type(gc, "symbolp", name);
+        }
+
+        if (!list_of_symbols_p(args_list)) {
+            return wrong_argument_type(gc, "list-of-symbolsp", args_list);
+        }
+
+        scope_escape(gc, scope);
+        Expr macro = atom_as_expr(create_macro_atom(gc, args_list, body, scope->expr));
+        set_scope_value(gc, scope, name, macro);
+
+        return eval_success(macro);
+    }
+};
+
+/*
+* Defines a global constant: (defconst name value).
+* The value is evaluated once and bound like `set` would, 
+    but the optimizer may also substitute it into lambda bodies created afterwards.
+* Rebinding the name later is allowed; it invalidates the substituted bodies.
+*/
+struct DefconstFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr name = void_expr();
+        Expr value = void_expr();
+        EvalResult result = match_list(gc, "ee", args, &name, &value);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!symbol_p(name)) {
+            return wrong_argument_type(gc, "symbolp", name);
+        }
+
+        result = eval(gc, scope, value);
+        if (result.is_error) {
+            return result;
+        }
+
+        set_scope_value(gc, scope, name, result.expr);
+        gc->constants.insert(name.atom->sym);
+
+        return eval_success(result.expr);
+    }
+};
+
 /*
 * Represents a conditional operation similar to 'if' statements in other programming languages.
 * It evaluates a given condition; if the condition is true (non-nil), it executes a block of code.
@@ -502,12 +606,10 @@ struct WhenFn {
 };
 
 /*
-* Creates an anonymous function (lambda) with a specified list of parameters and a body.
-* Lambda functions are powerful constructs for scenarios requiring function objects, 
-    closures, or higher-order functions.
-* The created lambda function can be passed as an argument, returned from other functions, or bound to a variable.
+* Evaluates `then` if the condition is not nil, otherwise the else forms as a block:
+    (if condition then else...).
 */
-struct LambdaOpFn {
+struct IfFn {
     Gc* gc;
     Scope* scope;
 
@@ -515,28 +617,31 @@ struct LambdaOpFn {
         (void)gc;
         assert(scope);
 
-        Expr args_list = void_expr();
-        Expr body = void_expr();
+        Expr condition = void_expr();
+        Expr then = void_expr();
+        Expr otherwise = void_expr();
 
-        EvalResult result = match_list(gc, "e*", args, &args_list, &body);
+        EvalResult result = match_list(gc, "ee*", args, &condition, &then, &otherwise);
         if (result.is_error) {
             return result;
         }
 
-        if (!list_of_symbols_p(args_list)) {
-            return wrong_argument_type(gc, "list-of-symbolsp", args_list);
+        result = eval(gc, scope, condition);
+        if (result.is_error) {
+            return result;
         }
 
-        return eval_success(lambda(gc, args_list, body, scope));
+        return !nil_p(result.expr)
+            ? eval(gc, scope, then)
+            : eval_block(gc, scope, otherwise);
     }
 };
 
 /*
-* Checks for equality between two expressions.
-* It evaluates to a truthy value if both expressions are equal, 
-    according to the defined equality semantics of the language.
+* Evaluates the body of the first clause whose test is not nil: (cond (test body...)...).
+* A clause without a body returns the value of its test; no matching clause returns nil.
 */
-struct EqualOpFn {
+struct CondFn {
     Gc* gc;
     Scope* scope;
 
@@ -544,29 +649,99 @@ struct EqualOpFn {
         (void)gc;
         assert(scope);
 
-        Expr obj1;  
-        Expr obj2;
-        EvalResult result = match_list(gc, "ee", args, &obj1, &obj2);
-        if (result.is_error) {
-            return result;
+        for (; !nil_p(args); args = CDR(args)) {
+            if (!cons_p(args)) {
+                return wrong_argument_type(gc, "consp", args);
+            }
+
+            Expr test = void_expr();
+            Expr body = void_expr();
+
+            EvalResult result = match_list(gc, "e*", CAR(args), &test, &body);
+            if (result.is_error) {
+                return result;
+            }
+
+            result = eval(gc, scope, test);
+            if (result.is_error) {
+                return result;
+            }
+
+            if (nil_p(result.expr)) {
+                continue;
+            }
+
+            return nil_p(body) ? result : eval_block(gc, scope, body);
         }
 
-        if (equal(obj1, obj2)) {
-            return eval_success(T(gc));
+        return eval_success(NIL(gc));
+    }
+};
+
+/*
+* Evaluates its arguments until one is nil and returns the last value: (and forms...).
+* Without arguments it returns t.
+*/
+struct AndFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        EvalResult result = eval_success(T(gc));
+
+        for (; !nil_p(args); args = CDR(args)) {
+            if (!cons_p(args)) {
+                return wrong_argument_type(gc, "consp", args);
+            }
+
+            result = eval(gc, scope, CAR(args));
+            if (result.is_error || nil_p(result.expr)) {
+                return result;
+            }
         }
-        else {
-            return eval_success(NIL(gc));
+
+        return result;
+    }
+};
+
+/*
+* Evaluates its arguments until one is not nil and returns it: (or forms...).
+* Without arguments, or if all are nil, it returns nil.
+*/
+struct OrFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        for (; !nil_p(args); args = CDR(args)) {
+            if (!cons_p(args)) {
+                return wrong_argument_type(gc, "consp", args);
+            }
+
+            EvalResult result = eval(gc, scope, CAR(args));
+            if (result.is_error || !nil_p(result.expr)) {
+                return result;
+            }
         }
+
+        return eval_success(NIL(gc));
     }
 };
 
 /*
-* Responsible for loading and executing Lisp code from an external file.
-* This function parses the file specified by the filename argument, 
-    reading all expressions contained within.
-* Once parsed, the expressions are sequentially evaluated within the given scope.
+* Evaluates the body of the clause whose keys contain the value of the key form:
+    (case key (keys body...)... (t body...)).
+* Keys are an atom or a list of atoms; a `t` or `otherwise` clause matches anything.
+* The clauses are indexed once per form into a CaseTable (cached in Gc::case_tables),
+    so dispatch is a hash lookup for integer and symbol keys instead of a chain of equal tests.
 */
-struct LoadFn {
+struct CaseFn {
     Gc* gc;
     Scope* scope;
 
@@ -574,29 +749,118 @@ struct LoadFn {
         (void)gc;
         assert(scope);
 
-        const char* filename = NULL;
-        EvalResult result = match_list(gc, "s", args, &filename);
+        Expr key = void_expr();
+        Expr clauses = void_expr();
+
+        EvalResult result = match_list(gc, "e*", args, &key, &clauses);
         if (result.is_error) {
             return result;
         }
 
-        ParseResult parse_result = read_all_exprs_from_file(gc, filename);
-        if (parse_result.is_error) {
-            // Include the line number and column number in the error message
-            return read_error(gc, parse_result.error_message, parse_result.line, parse_result.column);
+        auto cached = gc->case_tables.find(args.cons);
+        if (cached == gc->case_tables.end()) {
+            CaseTable table = {};
+            result = build_table(clauses, &table);
+            if (result.is_error) {
+                return result;
+            }
+            cached = gc->case_tables.emplace(args.cons, std::move(table)).first;
         }
 
-        return eval_block(gc, scope, parse_result.expr);
+        result = eval(gc, scope, key);
+        if (result.is_error) {
+            return result;
+        }
+
+        const CaseTable& table = cached->second;
+        const Expr value = result.expr;
+
+        if (integer_p(value)) {
+            auto it = table.integers.find(value.atom->num);
+            if (it != table.integers.end()) {
+                return eval_block(gc, scope, it->second);
+            }
+        } else if (symbol_p(value)) {
+            auto it = table.symbols.find(value.atom->sym);
+            if (it != table.symbols.end()) {
+                return eval_block(gc, scope, it->second);
+            }
+        } else {
+            for (const auto& [other, body] : table.others) {
+                if (equal(other, value)) {
+                    return eval_block(gc, scope, body);
+                }
+            }
+        }
+
+        return table.has_otherwise
+            ? eval_block(gc, scope, table.otherwise)
+            : eval_success(NIL(gc));
+    }
+
+private:
+    // The first clause that mentions a key wins, like in a linear search.
+    void add_key(CaseTable* table, Expr key, Expr body) {
+        if (integer_p(key)) {
+            table->integers.emplace(key.atom->num, body);
+        } else if (symbol_p(key)) {
+            table->symbols.emplace(key.atom->sym, body);
+        } else {
+            table->others.emplace_back(key, body);
+        }
+    }
+
+    EvalResult build_table(Expr clauses, CaseTable* table) {
+        for (; !nil_p(clauses); clauses = CDR(clauses)) {
+            if (!cons_p(clauses)) {
+                return wrong_argument_type(gc, "consp", clauses);
+            }
+
+            Expr keys = void_expr();
+            Expr body = void_expr();
+
+            EvalResult result = match_list(gc, "e*", CAR(clauses), &keys, &body);
+            if (result.is_error) {
+                return result;
+            }
+
+            if (symbol_p(keys) && (keys.atom == t_atom || keys.atom->sym == "otherwise")) {
+                // A linear search never gets past a catch-all clause.
+                table->otherwise = body;
+                table->has_otherwise = true;
+                break;
+            } else if (cons_p(keys)) {
+                if (!list_p(keys)) {
+                    return wrong_argument_type(gc, "listp", keys);
+                }
+                for (; !nil_p(keys); keys = CDR(keys)) {
+                    add_key(table, CAR(keys), body);
+                }
+            } else if (!nil_p(keys)) {
+                add_key(table, keys, body);
+            }
+        }
+
+        return eval_success(NIL(gc));
     }
 };
 
 /*
-* Concatenates multiple lists into a single list.
-* It takes a list of lists as an argument and merges them, preserving the order.
-* This operation is recursive, ensuring that all nested lists are appended in order.
-* Handy for operations requiring the combination of multiple sequences into one.
+* A `throw` in flight. It unwinds the C++ stack straight to the matching CatchFn,
+    so the frames in between don't test and return it like an EvalResult error,
+    and nothing is paid for it while no throw happens.
 */
-struct AppendFn {
+struct LispThrow {
+    Expr tag;
+    Expr value;
+};
+
+/*
+* Unwinds to the innermost `catch` with an equal tag: (throw tag value).
+* Without such a catch it is an ordinary `no-catch` error, so a LispThrow
+    never escapes to code that doesn't expect it.
+*/
+struct ThrowFn {
     Gc* gc;
     Scope* scope;
 
@@ -604,35 +868,1337 @@ struct AppendFn {
         (void)gc;
         assert(scope);
 
-        if (nil_p(args)) {
-            return eval_success(NIL(gc));
+        Expr tag = void_expr();
+        Expr value = void_expr();
+
+        EvalResult result = match_list(gc, "ee", args, &tag, &value);
+        if (result.is_error) {
+            return result;
+        }
+
+        const bool caught = std::any_of(gc->catch_tags.begin(), gc->catch_tags.end(),
+                                        [tag](Expr catch_tag) { return equal(catch_tag, tag); });
+        if (!caught) {
+            return eval_failure(list(gc, "qee", "no-catch", tag, value));
         }
 
-        return append_helper(*this, gc, scope, args);
+        throw LispThrow { tag, value };
     }
+};
 
-private:
-    EvalResult append_helper(Gc* gc, Scope* scope, Expr xs) {
-        if (nil_p(xs)) {
-            return eval_success(NIL(gc));
+/*
+* Evaluates the body and returns the value of a `throw` to the same tag, if one happens:
+    (catch tag body...).
+* On a throw the scope and the region are restored to what they were on entry.
+*/
+struct CatchFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr tag = void_expr();
+        Expr body = void_expr();
+
+        EvalResult result = match_list(gc, "e*", args, &tag, &body);
+        if (result.is_error) {
+            return result;
         }
 
-        Expr xs1 = void_expr();
-        Expr x = void_expr();
-        EvalResult result = match_list(gc, "e*", xs, &x, &xs1);
+        result = eval(gc, scope, tag);
         if (result.is_error) {
             return result;
         }
 
-        EvalResult result_xs1 = append_helper(gc, scope, xs1);
-        if (result_xs1.is_error) {
-            return result_xs1;
+        tag = result.expr;
+
+        const size_t depth = scope_depth(scope);
+        const size_t mark = region_mark(gc);
+        const size_t eval_depth = gc->eval_depth;
+        const size_t catches = gc->catch_tags.size();
+        gc->catch_tags.push_back(tag);
+
+        try {
+            result = eval_block(gc, scope, body);
+        } catch (const LispThrow& thrown) {
+            gc->catch_tags.resize(catches);
+            if (!equal(thrown.tag, tag)) {
+                throw;
+            }
+
+            while (scope_depth(scope) > depth) {
+                pop_scope_frame(gc, scope);
+            }
+            region_release(gc, mark);
+            gc->eval_depth = eval_depth;
+
+            return eval_success(thrown.value);
         }
 
-        return eval_success(CONS(gc, x, result_xs1.expr));
+        gc->catch_tags.resize(catches);
+        return result;
     }
 };
 
+/*
+* Evaluates a form and handles the errors it returns:
+    (condition-case var form (conditions handler...)...).
+* A clause matches when one of its conditions (a symbol or a list of them) is the
+    head of the error, or is `error` or `t`; its handler runs with `var` bound to the error.
+* Errors are only turned into bindings here, the success path is not affected.
+    Clauses are matched on the head symbol alone, so a pending error
+    (see wrong_argument_type) is only built when `var` is bound to it.
+*/
+struct ConditionCaseFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr var = void_expr();
+        Expr form = void_expr();
+        Expr clauses = void_expr();
+
+        EvalResult result = match_list(gc, "ee*", args, &var, &form, &clauses);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!symbol_p(var)) {
+            return wrong_argument_type(gc, "symbolp", var);
+        }
+
+        const size_t depth = scope_depth(scope);
+        const size_t mark = region_mark(gc);
+
+        const EvalResult failure = eval(gc, scope, form);
+        if (!failure.is_error) {
+            return failure;
+        }
+
+        assert(scope_depth(scope) == depth);
+
+        for (; cons_p(clauses); clauses = CDR(clauses)) {
+            Expr conditions = void_expr();
+            Expr handler = void_expr();
+
+            EvalResult clause = match_list(gc, "e*", CAR(clauses), &conditions, &handler);
+            if (clause.is_error) {
+                return clause;
+            }
+
+            if (!matches(conditions, failure)) {
+                continue;
+            }
+
+            if (nil_p(var)) {
+                region_release(gc, mark);
+                return eval_block(gc, scope, handler);
+            }
+
+            // The error may point into frames and argument lists of the calls that failed.
+            Expr error = region_evacuate(gc, error_object(gc, failure));
+            region_release(gc, mark);
+
+            push_scope_frame(gc, scope, CONS(gc, var, NIL(gc)), CONS(gc, error, NIL(gc)));
+            result = eval_block(gc, scope, handler);
+            pop_scope_frame(gc, scope);
+
+            return result;
+        }
+
+        return failure;
+    }
+
+private:
+    bool matches(Expr conditions, EvalResult failure) {
+        if (symbol_p(conditions)) {
+            return conditions.atom == t_atom
+                || conditions.atom->sym == "error"
+                || error_named(gc, failure, conditions.atom->sym);
+        }
+
+        for (; cons_p(conditions); conditions = CDR(conditions)) {
+            if (matches(CAR(conditions), failure)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+/*
+* Evaluates the body for as long as the condition is not nil: (while condition body...).
+* The loop runs in C++, so iterations cost neither a call_lambda nor a native stack level.
+* Always returns nil.
+*/
+struct WhileFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr condition = void_expr();
+        Expr body = void_expr();
+
+        EvalResult result = match_list(gc, "e*", args, &condition, &body);
+        if (result.is_error) {
+            return result;
+        }
+
+        while (true) {
+            result = eval_step(gc);
+            if (result.is_error) {
+                return result;
+            }
+
+            result = eval(gc, scope, condition);
+            if (result.is_error) {
+                return result;
+            }
+
+            if (nil_p(result.expr)) {
+                return eval_success(NIL(gc));
+            }
+
+            result = eval_block(gc, scope, body);
+            if (result.is_error) {
+                return result;
+            }
+        }
+    }
+};
+
+/*
+* Binds the variable of dotimes and dolist in a frame of its own and returns its binding cell.
+* The loops assign that one cell on every iteration instead of pushing a frame per iteration;
+    a closure made in the body therefore sees the variable's latest value.
+*/
+static Expr push_loop_frame(Gc* gc, Scope* scope, Expr var, Expr value) {
+    push_scope_frame(gc, scope, CONS(gc, var, NIL(gc)), CONS(gc, value, NIL(gc)));
+    return scope->expr.cons->car.cons->car;
+}
+
+/*
+* Evaluates the body with the variable bound to 0, 1, ..., count - 1:
+    (dotimes (var count result...) body...).
+* The result forms are evaluated with the variable bound to count; without them it returns nil.
+*/
+struct DotimesFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr spec = void_expr();
+        Expr body = void_expr();
+        Expr var = void_expr();
+        Expr count = void_expr();
+        Expr result_forms = void_expr();
+
+        EvalResult result = match_list(gc, "e*", args, &spec, &body);
+        if (result.is_error) {
+            return result;
+        }
+
+        result = match_list(gc, "ee*", spec, &var, &count, &result_forms);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!symbol_p(var)) {
+            return wrong_argument_type(gc, "symbolp", var);
+        }
+
+        result = eval(gc, scope, count);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!integer_p(result.expr)) {
+            return wrong_argument_type(gc, "integerp", result.expr);
+        }
+
+        const long int n = result.expr.atom->num;
+        Expr cell = push_loop_frame(gc, scope, var, INTEGER(gc, 0L));
+
+        for (long int i = 0; i < n; ++i) {
+            result = eval_step(gc);
+            if (result.is_error) {
+                pop_scope_frame(gc, scope);
+                return result;
+            }
+
+            if (i > 0) {
+                cell.cons->cdr = INTEGER(gc, i);
+            }
+
+            result = eval_block(gc, scope, body);
+            if (result.is_error) {
+                pop_scope_frame(gc, scope);
+                return result;
+            }
+        }
+
+        cell.cons->cdr = INTEGER(gc, n);
+        result = eval_block(gc, scope, result_forms);
+        pop_scope_frame(gc, scope);
+
+        return result;
+    }
+};
+
+/*
+* Evaluates the body with the variable bound to each element of a list in turn:
+    (dolist (var list result...) body...).
+* The result forms are evaluated with the variable bound to nil; without them it returns nil.
+*/
+struct DolistFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr spec = void_expr();
+        Expr body = void_expr();
+        Expr var = void_expr();
+        Expr xs = void_expr();
+        Expr result_forms = void_expr();
+
+        EvalResult result = match_list(gc, "e*", args, &spec, &body);
+        if (result.is_error) {
+            return result;
+        }
+
+        result = match_list(gc, "ee*", spec, &var, &xs, &result_forms);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!symbol_p(var)) {
+            return wrong_argument_type(gc, "symbolp", var);
+        }
+
+        result = eval(gc, scope, xs);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!list_p(result.expr)) {
+            return wrong_argument_type(gc, "listp", result.expr);
+        }
+
+        Expr cell = push_loop_frame(gc, scope, var, NIL(gc));
+
+        for (xs = result.expr; !nil_p(xs); xs = CDR(xs)) {
+            result = eval_step(gc);
+            if (result.is_error) {
+                pop_scope_frame(gc, scope);
+                return result;
+            }
+
+            cell.cons->cdr = CAR(xs);
+
+            result = eval_block(gc, scope, body);
+            if (result.is_error) {
+                pop_scope_frame(gc, scope);
+                return result;
+            }
+        }
+
+        cell.cons->cdr = NIL(gc);
+        result = eval_block(gc, scope, result_forms);
+        pop_scope_frame(gc, scope);
+
+        return result;
+    }
+};
+
+/*
+* Splits one binding of let, let* or letrec: `(var init)`, `(var)` or `var`.
+* A missing init is nil.
+*/
+static EvalResult let_binding(Gc* gc, Expr binding, Expr* var, Expr* init) {
+    *init = NIL(gc);
+
+    if (symbol_p(binding)) {
+        *var = binding;
+        return eval_success(NIL(gc));
+    }
+
+    Expr rest = void_expr();
+    EvalResult result = match_list(gc, "e*", binding, var, &rest);
+    if (result.is_error) {
+        return result;
+    }
+
+    if (!symbol_p(*var)) {
+        return wrong_argument_type(gc, "symbolp", *var);
+    }
+
+    return nil_p(rest) ? result : match_list(gc, "e", rest, init);
+}
+
+/*
+* The let forms push one frame on the current scope and bind straight into it,
+    no lambda is created and nothing goes through call_lambda: (let (bindings...) body...).
+* Every exit pops the frame again, so the rest of the enclosing body never sees it.
+*/
+static EvalResult eval_let_body(Gc* gc, Scope* scope, Expr body) {
+    EvalResult result = eval_block(gc, scope, body);
+    pop_scope_frame(gc, scope);
+    return result;
+}
+
+/*
+* let evaluates all inits in the enclosing scope first, then binds them.
+*/
+struct LetFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr bindings = void_expr();
+        Expr body = void_expr();
+
+        EvalResult result = match_list(gc, "e*", args, &bindings, &body);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!list_p(bindings)) {
+            return wrong_argument_type(gc, "listp", bindings);
+        }
+
+        std::vector<Expr> vars;
+        std::vector<Expr> values;
+
+        for (Expr xs = bindings; !nil_p(xs); xs = CDR(xs)) {
+            Expr var = void_expr();
+            Expr init = void_expr();
+
+            result = let_binding(gc, CAR(xs), &var, &init);
+            if (result.is_error) {
+                return result;
+            }
+
+            result = eval(gc, scope, init);
+            if (result.is_error) {
+                return result;
+            }
+
+            vars.push_back(var);
+            values.push_back(result.expr);
+        }
+
+        push_scope_frame(gc, scope, NIL(gc), NIL(gc));
+        for (size_t i = 0; i < vars.size(); ++i) {
+            bind_in_scope_frame(gc, scope, vars[i], values[i]);
+        }
+
+        return eval_let_body(gc, scope, body);
+    }
+};
+
+/*
+* let* binds one variable at a time, each init sees the variables before it.
+*/
+struct LetStarFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr bindings = void_expr();
+        Expr body = void_expr();
+
+        EvalResult result = match_list(gc, "e*", args, &bindings, &body);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!list_p(bindings)) {
+            return wrong_argument_type(gc, "listp", bindings);
+        }
+
+        push_scope_frame(gc, scope, NIL(gc), NIL(gc));
+
+        for (Expr xs = bindings; !nil_p(xs); xs = CDR(xs)) {
+            Expr var = void_expr();
+            Expr init = void_expr();
+
+            result = let_binding(gc, CAR(xs), &var, &init);
+            if (!result.is_error) {
+                result = eval(gc, scope, init);
+            }
+
+            if (result.is_error) {
+                pop_scope_frame(gc, scope);
+                return result;
+            }
+
+            bind_in_scope_frame(gc, scope, var, result.expr);
+        }
+
+        return eval_let_body(gc, scope, body);
+    }
+};
+
+/*
+* letrec binds every variable to nil first and then assigns the inits in order,
+    so lambdas in the inits can refer to each other and to themselves.
+*/
+struct LetrecFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr bindings = void_expr();
+        Expr body = void_expr();
+
+        EvalResult result = match_list(gc, "e*", args, &bindings, &body);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!list_p(bindings)) {
+            return wrong_argument_type(gc, "listp", bindings);
+        }
+
+        std::vector<Expr> cells;
+        std::vector<Expr> inits;
+
+        push_scope_frame(gc, scope, NIL(gc), NIL(gc));
+
+        for (Expr xs = bindings; !nil_p(xs); xs = CDR(xs)) {
+            Expr var = void_expr();
+            Expr init = void_expr();
+
+            result = let_binding(gc, CAR(xs), &var, &init);
+            if (result.is_error) {
+                pop_scope_frame(gc, scope);
+                return result;
+            }
+
+            cells.push_back(bind_in_scope_frame(gc, scope, var, NIL(gc)));
+            inits.push_back(init);
+        }
+
+        for (size_t i = 0; i < cells.size(); ++i) {
+            result = eval(gc, scope, inits[i]);
+            if (result.is_error) {
+                pop_scope_frame(gc, scope);
+                return result;
+            }
+
+            cells[i].cons->cdr = result.expr;
+        }
+
+        return eval_let_body(gc, scope, body);
+    }
+};
+
+/*
+* Creates an anonymous function (lambda) with a specified list of parameters and a body.
+* Lambda functions are powerful constructs for scenarios requiring function objects, 
+    closures, or higher-order functions.
+* The created lambda function can be passed as an argument, returned from other functions, or bound to a variable.
+*/
+struct LambdaOpFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr args_list = void_expr();
+        Expr body = void_expr();
+
+        EvalResult result = match_list(gc, "e*", args, &args_list, &body);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!list_of_symbols_p(args_list)) {
+            return wrong_argument_type(gc, "list-of-symbolsp", args_list);
+        }
+
+        return eval_success(lambda(gc, args_list, body, scope));
+    }
+};
+
+/*
+* Checks for equality between two expressions.
+* It evaluates to a truthy value if both expressions are equal, 
+    according to the defined equality semantics of the language.
+*/
+struct EqualOpFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        Expr obj1;  
+        Expr obj2;
+        EvalResult result = match_list(gc, "ee", args, &obj1, &obj2);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (equal(obj1, obj2)) {
+            return eval_success(T(gc));
+        }
+        else {
+            return eval_success(NIL(gc));
+        }
+    }
+};
+
+/*
+* Responsible for loading and executing Lisp code from an external file.
+* This function parses the file specified by the filename argument, 
+    reading all expressions contained within.
+* Once parsed, the expressions are sequentially evaluated within the given scope.
+*/
+struct LoadFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        const char* filename = NULL;
+        EvalResult result = match_list(gc, "s", args, &filename);
+        if (result.is_error) {
+            return result;
+        }
+
+        // Keep the source alive here: the error position is a cursor into it.
+        std::ifstream stream(filename, std::ios::binary);
+        if (!stream) {
+            return read_error(gc, strerror(errno), 0);
+        }
+        const std::string source((std::istreambuf_iterator<char>(stream)),
+                                 std::istreambuf_iterator<char>());
+
+        ParseResult parse_result = read_all_exprs_from_string(gc, source.c_str());
+        if (parse_result.is_error) {
+            return read_error(gc, parse_result.error_message, parse_result.end - source.c_str());
+        }
+
+        return eval_block(gc, scope, parse_result.expr);
+    }
+};
+
+/*
+* Loads a shared object compiled ahead of time from Lisp sources (see aot.cpp)
+    and binds the functions it defines, like `load` would for the original files.
+*/
+struct LoadNativeFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        (void)gc;
+        assert(scope);
+
+        const char* filename = NULL;
+        EvalResult result = match_list(gc, "s", args, &filename);
+        if (result.is_error) {
+            return result;
+        }
+
+        return aot_load_native(gc, scope, filename);
+    }
+};
+
+/*
+* Concatenates multiple lists into a single list.
+* It takes a list of lists as an argument and merges them, preserving the order.
+* The elements of all but the last list are copied into one run of adjacent conses
+    (see list_from_array); the last list is shared, as usual in Lisp.
+* Handy for operations requiring the combination of multiple sequences into one.
+*/
+struct AppendFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        if (nil_p(args)) {
+            return eval_success(NIL(gc));
+        }
+
+        std::vector<Expr> items;
+
+        for (; cons_p(CDR(args)); args = CDR(args)) {
+            Expr xs = CAR(args);
+            if (!list_p(xs)) {
+                return wrong_argument_type(gc, "listp", xs);
+            }
+
+            for (; cons_p(xs); xs = CDR(xs)) {
+                items.push_back(CAR(xs));
+            }
+        }
+
+        return eval_success(list_from_array(gc, items.data(), items.size(), CAR(args)));
+    }
+};
+
+/*
+* Weak references: (make-weak-box x) refers to x without keeping it alive;
+    (weak-box-value box) is x, or nil once the collector has freed it.
+*/
+struct MakeWeakBoxFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        Expr value = NIL(gc);
+        EvalResult result = match_list(gc, "e", args, &value);
+        if (result.is_error) {
+            return result;
+        }
+
+        return eval_success(atom_as_expr(create_weak_box_atom(gc, value)));
+    }
+};
+
+struct WeakBoxValueFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        Expr box = NIL(gc);
+        EvalResult result = match_list(gc, "e", args, &box);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!weak_box_p(box)) {
+            return wrong_argument_type(gc, "weak-box-p", box);
+        }
+
+        return eval_success(box.atom->weak);
+    }
+};
+
+/*
+* Ephemeron tables, for caches that must not outlive their keys:
+    (make-weak-table), (weak-table-get table key), (weak-table-put table key value),
+    (weak-table-remove table key) and (weak-table-count table).
+    Keys are compared with eq. A value stays alive while its key does, even when
+    the value refers back to the key.
+* Symbols and numbers are not valid keys: the reader and arithmetic make a new atom
+    for each of them, so an equal key would almost never be the same object and
+    lookups would silently miss. get, put and remove fail with
+    (wrong-argument-type weak-key-p key) instead. nil and t are unique and allowed.
+*/
+static bool weak_key_p(Expr key)
+{
+    if (symbol_p(key)) {
+        return key.atom == nil_atom || key.atom == t_atom;
+    }
+
+    return !integer_p(key) && !real_p(key);
+}
+
+struct MakeWeakTableFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        EvalResult result = match_list(gc, "", args);
+        if (result.is_error) {
+            return result;
+        }
+
+        return eval_success(atom_as_expr(create_weak_table_atom(gc)));
+    }
+};
+
+struct WeakTableGetFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        Expr table = NIL(gc);
+        Expr key = NIL(gc);
+        EvalResult result = match_list(gc, "ee", args, &table, &key);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!weak_table_p(table)) {
+            return wrong_argument_type(gc, "weak-table-p", table);
+        }
+        table = gc_forwarded(gc, table);
+
+        if (!weak_key_p(key)) {
+            return wrong_argument_type(gc, "weak-key-p", key);
+        }
+
+        // A table outside the request region was keyed by the heap copies of region keys.
+        if (!gc_request_owns(gc, table.atom)) {
+            key = gc_forwarded(gc, key);
+        }
+
+        auto entry = table.atom->table->entries.find(expr_identity(key));
+        if (entry == table.atom->table->entries.end()) {
+            return eval_success(NIL(gc));
+        }
+
+        return eval_success(entry->second.second);
+    }
+};
+
+struct WeakTablePutFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        Expr table = NIL(gc);
+        Expr key = NIL(gc);
+        Expr value = NIL(gc);
+        EvalResult result = match_list(gc, "eee", args, &table, &key, &value);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!weak_table_p(table)) {
+            return wrong_argument_type(gc, "weak-table-p", table);
+        }
+        table = gc_forwarded(gc, table);
+
+        if (!weak_key_p(key)) {
+            return wrong_argument_type(gc, "weak-key-p", key);
+        }
+
+        // An older table must not refer into the request region; the key may be moved out of it.
+        key = gc_write_barrier(gc, table.atom, key);
+        value = gc_write_barrier(gc, table.atom, value);
+        table.atom->table->entries[expr_identity(key)] = std::make_pair(key, value);
+
+        return eval_success(value);
+    }
+};
+
+struct WeakTableRemoveFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        Expr table = NIL(gc);
+        Expr key = NIL(gc);
+        EvalResult result = match_list(gc, "ee", args, &table, &key);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!weak_table_p(table)) {
+            return wrong_argument_type(gc, "weak-table-p", table);
+        }
+        table = gc_forwarded(gc, table);
+
+        if (!weak_key_p(key)) {
+            return wrong_argument_type(gc, "weak-key-p", key);
+        }
+
+        if (!gc_request_owns(gc, table.atom)) {
+            key = gc_forwarded(gc, key);
+        }
+
+        return eval_success(bool_as_expr(table.atom->table->entries.erase(expr_identity(key)) > 0));
+    }
+};
+
+struct WeakTableCountFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        Expr table = NIL(gc);
+        EvalResult result = match_list(gc, "e", args, &table);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!weak_table_p(table)) {
+            return wrong_argument_type(gc, "weak-table-p", table);
+        }
+        table = gc_forwarded(gc, table);
+
+        return eval_success(INTEGER(gc, table.atom->table->entries.size()));
+    }
+};
+
+/*
+* (finalize object fn) calls fn without arguments after a collection found object unreachable.
+    Finalizers run between top-level forms, once each; their errors are ignored.
+    A finalizer that refers to its object keeps it alive until it has run.
+*/
+struct FinalizeFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        Expr object = NIL(gc);
+        Expr callable = NIL(gc);
+        EvalResult result = match_list(gc, "ee", args, &object, &callable);
+        if (result.is_error) {
+            return result;
+        }
+
+        gc_add_finalizer(gc, object, callable);
+
+        return eval_success(object);
+    }
+};
+
+/*
+* String builders, for strings assembled piece by piece in a loop:
+    (make-string-builder), (sb-append! sb string ...) returning sb,
+    (sb-length sb) and (sb->string sb). Appending costs the length of the
+    appended string, or nothing for long strings, which are kept by reference
+    until sb->string flattens the whole rope at once.
+*/
+struct MakeStringBuilderFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        EvalResult result = match_list(gc, "", args);
+        if (result.is_error) {
+            return result;
+        }
+
+        return eval_success(atom_as_expr(create_string_builder_atom(gc)));
+    }
+};
+
+struct SbAppendFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        Expr builder = NIL(gc);
+        Expr strings = NIL(gc);
+        EvalResult result = match_list(gc, "e*", args, &builder, &strings);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!string_builder_p(builder)) {
+            return wrong_argument_type(gc, "string-builder-p", builder);
+        }
+        builder = gc_forwarded(gc, builder);
+
+        for (; cons_p(strings); strings = CDR(strings)) {
+            if (!string_p(CAR(strings))) {
+                return wrong_argument_type(gc, "stringp", CAR(strings));
+            }
+
+            string_builder_append(gc, builder.atom->builder,
+                                  gc_write_barrier(gc, builder.atom, CAR(strings)));
+        }
+
+        return eval_success(builder);
+    }
+};
+
+struct SbLengthFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        Expr builder = NIL(gc);
+        EvalResult result = match_list(gc, "e", args, &builder);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!string_builder_p(builder)) {
+            return wrong_argument_type(gc, "string-builder-p", builder);
+        }
+        builder = gc_forwarded(gc, builder);
+
+        return eval_success(INTEGER(gc, builder.atom->builder->length));
+    }
+};
+
+struct SbToStringFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        assert(scope);
+
+        Expr builder = NIL(gc);
+        EvalResult result = match_list(gc, "e", args, &builder);
+        if (result.is_error) {
+            return result;
+        }
+
+        if (!string_builder_p(builder)) {
+            return wrong_argument_type(gc, "string-builder-p", builder);
+        }
+        builder = gc_forwarded(gc, builder);
+
+        return eval_success(string_builder_flatten(gc, builder.atom));
+    }
+};
+
+/*
+* ### Strings.
+    The natives below read the text of string atoms in place through std::string_view
+    and write results straight into the new atom, so no temporary std::string is made.
+    Strings are immutable, so a result equal to an argument is that argument.
+*/
+
+// Fetches the text of a string argument without copying it.
+static EvalResult string_arg(Gc* gc, Expr x, std::string_view* text) {
+    if (!string_p(x)) {
+        return wrong_argument_type(gc, "stringp", x);
+    }
+
+    *text = x.atom->str;
+    return eval_success(x);
+}
+
+static Expr string_expr(Gc* gc, std::string_view text) {
+    return atom_as_expr(create_string_atom(gc, text.data(), text.data() + text.size()));
+}
+
+static EvalResult args_out_of_range(Gc* gc, Expr args) {
+    return eval_failure(CONS(gc, SYMBOL(gc, "args-out-of-range"), args));
+}
+
+// (string-length s)
+struct StringLengthFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        Expr s = NIL(gc);
+        std::string_view text;
+        EvalResult result = match_list(gc, "e", args, &s);
+        if (result.is_error || (result = string_arg(gc, s, &text)).is_error) {
+            return result;
+        }
+
+        return eval_success(INTEGER(gc, text.size()));
+    }
+};
+
+// (substring s start [end]); the whole string is returned as it is.
+struct SubstringFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        Expr s = NIL(gc);
+        long int start = 0;
+        Expr rest = NIL(gc);
+        std::string_view text;
+        EvalResult result = match_list(gc, "ed*", args, &s, &start, &rest);
+        if (result.is_error || (result = string_arg(gc, s, &text)).is_error) {
+            return result;
+        }
+
+        long int end = text.size();
+        if (!nil_p(rest) && (result = match_list(gc, "d", rest, &end)).is_error) {
+            return result;
+        }
+
+        if (start < 0 || end < start || (size_t) end > text.size()) {
+            return args_out_of_range(gc, args);
+        }
+
+        if (start == 0 && (size_t) end == text.size()) {
+            return eval_success(s);
+        }
+
+        return eval_success(string_expr(gc, text.substr(start, end - start)));
+    }
+};
+
+// (string-append s ...), copying each argument once into a string of the final size.
+struct StringAppendFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        size_t length = 0;
+        std::string_view text;
+
+        for (Expr xs = args; cons_p(xs); xs = CDR(xs)) {
+            EvalResult result = string_arg(gc, CAR(xs), &text);
+            if (result.is_error) {
+                return result;
+            }
+            length += text.size();
+        }
+
+        if (cons_p(args) && nil_p(CDR(args))) {
+            return eval_success(CAR(args));
+        }
+
+        Expr joined = string_expr(gc, "");
+        joined.atom->str.reserve(length);
+        gc_charge(gc, joined.atom->str.capacity());
+
+        for (Expr xs = args; cons_p(xs); xs = CDR(xs)) {
+            joined.atom->str.append(CAR(xs).atom->str);
+        }
+
+        return eval_success(joined);
+    }
+};
+
+// (string-index s needle [start]): position of the first needle at or after start, or nil.
+struct StringIndexFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        Expr s = NIL(gc);
+        Expr needle = NIL(gc);
+        Expr rest = NIL(gc);
+        std::string_view text, pattern;
+        EvalResult result = match_list(gc, "ee*", args, &s, &needle, &rest);
+        if (result.is_error
+            || (result = string_arg(gc, s, &text)).is_error
+            || (result = string_arg(gc, needle, &pattern)).is_error) {
+            return result;
+        }
+
+        long int start = 0;
+        if (!nil_p(rest) && (result = match_list(gc, "d", rest, &start)).is_error) {
+            return result;
+        }
+
+        if (start < 0 || (size_t) start > text.size()) {
+            return args_out_of_range(gc, args);
+        }
+
+        // A single character, the common case, is a memchr.
+        size_t position = std::string_view::npos;
+        if (pattern.size() == 1) {
+            const void* found = memchr(text.data() + start, pattern[0], text.size() - start);
+            if (found != NULL) {
+                position = static_cast<const char*>(found) - text.data();
+            }
+        } else {
+            position = text.find(pattern, start);
+        }
+
+        if (position == std::string_view::npos) {
+            return eval_success(NIL(gc));
+        }
+
+        return eval_success(INTEGER(gc, position));
+    }
+};
+
+// (string-split s separator): the pieces between separators, empty ones included.
+struct StringSplitFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        Expr s = NIL(gc);
+        Expr separator = NIL(gc);
+        std::string_view text, pattern;
+        EvalResult result = match_list(gc, "ee", args, &s, &separator);
+        if (result.is_error
+            || (result = string_arg(gc, s, &text)).is_error
+            || (result = string_arg(gc, separator, &pattern)).is_error) {
+            return result;
+        }
+
+        if (pattern.empty()) {
+            return args_out_of_range(gc, args);
+        }
+
+        std::vector<Expr> pieces;
+        size_t start = 0;
+
+        while (true) {
+            const size_t end = text.find(pattern, start);
+            if (end == std::string_view::npos) {
+                break;
+            }
+
+            pieces.push_back(string_expr(gc, text.substr(start, end - start)));
+            start = end + pattern.size();
+        }
+
+        pieces.push_back(start == 0 ? s : string_expr(gc, text.substr(start)));
+
+        return eval_success(list_from_array(gc, pieces.data(), pieces.size(), NIL(gc)));
+    }
+};
+
+// (string-join list separator)
+struct StringJoinFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        Expr strings = NIL(gc);
+        Expr separator = NIL(gc);
+        std::string_view text, pattern;
+        EvalResult result = match_list(gc, "ee", args, &strings, &separator);
+        if (result.is_error || (result = string_arg(gc, separator, &pattern)).is_error) {
+            return result;
+        }
+
+        if (!list_p(strings)) {
+            return wrong_argument_type(gc, "listp", strings);
+        }
+
+        size_t length = 0;
+        size_t count = 0;
+        for (Expr xs = strings; cons_p(xs); xs = CDR(xs), ++count) {
+            if ((result = string_arg(gc, CAR(xs), &text)).is_error) {
+                return result;
+            }
+            length += text.size();
+        }
+
+        Expr joined = string_expr(gc, "");
+        joined.atom->str.reserve(length + (count > 0 ? (count - 1) * pattern.size() : 0));
+        gc_charge(gc, joined.atom->str.capacity());
+
+        for (Expr xs = strings; cons_p(xs); xs = CDR(xs)) {
+            joined.atom->str.append(CAR(xs).atom->str);
+            if (cons_p(CDR(xs))) {
+                joined.atom->str.append(pattern);
+            }
+        }
+
+        return eval_success(joined);
+    }
+};
+
+// (string->number s): an integer or a real, or nil when s is not entirely a number.
+struct StringToNumberFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        Expr s = NIL(gc);
+        std::string_view text;
+        EvalResult result = match_list(gc, "e", args, &s);
+        if (result.is_error || (result = string_arg(gc, s, &text)).is_error) {
+            return result;
+        }
+
+        const char* begin = text.data();
+        const char* end = text.data() + text.size();
+
+        long int num = 0;
+        std::from_chars_result parsed = std::from_chars(begin, end, num);
+        if (parsed.ec == std::errc() && parsed.ptr == end) {
+            return eval_success(INTEGER(gc, num));
+        }
+
+        float real = 0;
+        parsed = std::from_chars(begin, end, real);
+        if (parsed.ec == std::errc() && parsed.ptr == end) {
+            return eval_success(REAL(gc, real));
+        }
+
+        return eval_success(NIL(gc));
+    }
+};
+
+// (number->string x), shortest text that reads back as x.
+struct NumberToStringFn {
+    Gc* gc;
+    Scope* scope;
+
+    EvalResult operator()(Expr args) {
+        Expr x = NIL(gc);
+        EvalResult result = match_list(gc, "e", args, &x);
+        if (result.is_error) {
+            return result;
+        }
+
+        char buffer[64];
+        std::to_chars_result written;
+
+        if (integer_p(x)) {
+            written = std::to_chars(buffer, buffer + sizeof(buffer), x.atom->num);
+        } else if (real_p(x)) {
+            written = std::to_chars(buffer, buffer + sizeof(buffer), x.atom->real);
+        } else {
+            return wrong_argument_type(gc, "numberp", x);
+        }
+
+        return eval_success(string_expr(gc, std::string_view(buffer, written.ptr - buffer)));
+    }
+};
+
+/*
+* Binds a native that the optimizer may evaluate ahead of time when all its arguments are constants.
+* Only natives without side effects, whose result depends on nothing but their arguments, qualify.
+* Such a native only reads its argument list, so eval_funcall may allocate it in the region.
+*/
+static void set_pure_native(Gc* gc, Scope* scope, const char* name, NativeFunction fun) {
+    Expr native = NATIVE(gc, fun, NULL);
+    native.atom->native.pure = true;
+    native.atom->native.borrows_args = true;
+    set_scope_value(gc, scope, SYMBOL(gc, name), native);
+}
+
 /*
 * Initializes the Lisp environment with the standard library functions and constants.
 * This includes basic arithmetic operations, list manipulation functions, 
@@ -640,9 +2206,9 @@ private:
 */
 void load_std_library(Gc* gc, Scope* scope) {
     set_scope_value(gc, scope, SYMBOL(gc, "car"), NATIVE(gc, car, NULL));
-    set_scope_value(gc, scope, SYMBOL(gc, ">"), NATIVE(gc, greaterThan, NULL));
-    set_scope_value(gc, scope, SYMBOL(gc, "+"), NATIVE(gc, plus_op, NULL));
-    set_scope_value(gc, scope, SYMBOL(gc, "*"), NATIVE(gc, mul_op, NULL));
+    set_pure_native(gc, scope, ">", greaterThan);
+    set_pure_native(gc, scope, "+", plus_op);
+    set_pure_native(gc, scope, "*", mul_op);
     set_scope_value(gc, scope, SYMBOL(gc, "list"), NATIVE(gc, list_op, NULL));
     set_scope_value(gc, scope, SYMBOL(gc, "t"), SYMBOL(gc, "t"));       // ???
     set_scope_value(gc, scope, SYMBOL(gc, "nil"), SYMBOL(gc, "nil"));
@@ -652,13 +2218,50 @@ void load_std_library(Gc* gc, Scope* scope) {
     set_scope_value(gc, scope, SYMBOL(gc, "quote"), NATIVE(gc, quote, NULL));
     set_scope_value(gc, scope, SYMBOL(gc, "begin"), NATIVE(gc, begin, NULL));
     set_scope_value(gc, scope, SYMBOL(gc, "defun"), NATIVE(gc, defun, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "defmacro"), NATIVE(gc, defmacro, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "defconst"), NATIVE(gc, defconst, NULL));
     set_scope_value(gc, scope, SYMBOL(gc, "when"), NATIVE(gc, when, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "if"), NATIVE(gc, if_op, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "cond"), NATIVE(gc, cond, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "and"), NATIVE(gc, and_op, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "or"), NATIVE(gc, or_op, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "case"), NATIVE(gc, case_op, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "catch"), NATIVE(gc, catch_op, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "throw"), NATIVE(gc, throw_op, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "condition-case"), NATIVE(gc, condition_case, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "while"), NATIVE(gc, while_op, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "dotimes"), NATIVE(gc, dotimes, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "dolist"), NATIVE(gc, dolist, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "let"), NATIVE(gc, let, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "let*"), NATIVE(gc, let_star, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "letrec"), NATIVE(gc, letrec, NULL));
     set_scope_value(gc, scope, SYMBOL(gc, "lambda"), NATIVE(gc, lambda_op, NULL));
     set_scope_value(gc, scope, SYMBOL(gc, "λ"), NATIVE(gc, lambda_op, NULL));       // ???
     set_scope_value(gc, scope, SYMBOL(gc, "unquote"), NATIVE(gc, unquote, NULL));
     set_scope_value(gc, scope, SYMBOL(gc, "load"), NATIVE(gc, load, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "load-native"), NATIVE(gc, load_native, NULL));
     set_scope_value(gc, scope, SYMBOL(gc, "append"), NATIVE(gc, append, NULL));
-    set_scope_value(gc, scope, SYMBOL(gc, "equal"), NATIVE(gc, equal_op, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "make-weak-box"), NATIVE(gc, make_weak_box, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "weak-box-value"), NATIVE(gc, weak_box_value, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "make-weak-table"), NATIVE(gc, make_weak_table, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "weak-table-get"), NATIVE(gc, weak_table_get, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "weak-table-put"), NATIVE(gc, weak_table_put, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "weak-table-remove"), NATIVE(gc, weak_table_remove, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "weak-table-count"), NATIVE(gc, weak_table_count, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "finalize"), NATIVE(gc, finalize, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "make-string-builder"), NATIVE(gc, make_string_builder, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "sb-append!"), NATIVE(gc, sb_append, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "sb-length"), NATIVE(gc, sb_length, NULL));
+    set_scope_value(gc, scope, SYMBOL(gc, "sb->string"), NATIVE(gc, sb_to_string, NULL));
+    set_pure_native(gc, scope, "equal", equal_op);
+    set_pure_native(gc, scope, "string-length", string_length);
+    set_pure_native(gc, scope, "substring", substring);
+    set_pure_native(gc, scope, "string-append", string_append_op);
+    set_pure_native(gc, scope, "string-index", string_index);
+    set_pure_native(gc, scope, "string-split", string_split);
+    set_pure_native(gc, scope, "string-join", string_join);
+    set_pure_native(gc, scope, "string->number", string_to_number);
+    set_pure_native(gc, scope, "number->string", number_to_string);
 }
 
 
@@ -10,7 +10,15 @@
 #include "scope.hpp"
 #include "parser.hpp"
 #include "expr.hpp"
+#include "optimizer.hpp"
 
 void load_std_library(Gc* gc, Scope* scope);
 
+// Natives bound to +, *, >, if and when, recognized by the JIT (see jit.cpp).
+EvalResult plus_op(void* param, Gc* gc, Scope* scope, Expr args);
+EvalResult mul_op(void* param, Gc* gc, Scope* scope, Expr args);
+EvalResult greaterThan(void* param, Gc* gc, Scope* scope, Expr args);
+EvalResult if_op(void* param, Gc* gc, Scope* scope, Expr args);
+EvalResult when(void* param, Gc* gc, Scope* scope, Expr args);
+
 #endif  // STD_H_
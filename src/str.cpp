@@ -15,25 +15,14 @@
 
 
 // Creates a duplicate of a given substring starting from `str` up to `str_end`. 
-// If `str_end` is not provided, duplicates the entire string
-std::string string_duplicate(const std::string& str, const std::string& str_end)
+// If `str_end` is not provided, duplicates the entire NUL-terminated string.
+std::string string_duplicate(const char* str, const char* str_end)
 {
     assert(str);
+    assert(str_end == nullptr || str <= str_end);
 
-    if (str_end != nullptr && str > str_end) {
-        return nullptr;
-    }
-
-    const size_t n = str_end == nullptr ? strlen(str) : (size_t) (str_end - str);
-    std::string dup_str = static_cast<std::string >(calloc(1, sizeof(char) * (n + 1)));
-    if (dup_str == nullptr) {
-        return nullptr;
-    }
-
-    std::memcpy(dup_str, str, n);
-    dup_str[n] = '\0';
-
-    return dup_str;
+    const size_t n = str_end == nullptr ? std::strlen(str) : (size_t) (str_end - str);
+    return std::string(str, n);
 }
 
 // Removes the newline character from the end of a string, if it exists.
@@ -52,16 +41,13 @@ std::string trim_endline(std::string s)
     return s;
 }
 
-// Concatenates two strings, `prefix` and `suffix`, into a single new string and returns it. 
+// Concatenates two strings, `prefix` and `suffix`, into a single new string and returns it.
+// One allocation of the final size; to build a string piece by piece use a string builder.
 std::string string_append(const std::string& prefix, const std::string& suffix)
 {
-    assert(suffix);
-
-    if (prefix == nullptr) {
-        return string_duplicate(suffix, nullptr);
-    }
-
-    prefix = static_cast<std::string>(realloc(prefix, std::strlen(prefix) + std::strlen(suffix) + 1));
-    std::strcat(prefix, suffix);
-    return prefix;
+    std::string result;
+    result.reserve(prefix.size() + suffix.size());
+    result.append(prefix);
+    result.append(suffix);
+    return result;
 }
@@ -6,12 +6,12 @@
 
 #include "tokenizer.hpp"
 
-// Creates a Token object representing a portion of a string from 'begin' to 'end'.
-Token token(const std::string& begin, const std::string& end)
+// Creates a Token object representing a portion of the buffer from 'begin' to 'end'.
+Token token(const char* begin, const char* end)
 {
     Token token = {
-        .begin = begin.c_str(),
-        .end = end.c_str()
+        .begin = begin,
+        .end = end
     };
 
     return token;
@@ -26,8 +26,12 @@ static bool is_symbol_char(char x)
     };
     static constexpr size_t n = sizeof(forbidden_symbol_chars) / sizeof(char);
 
+    if (x == 0 || std::isspace(static_cast<unsigned char>(x))) {
+        return false;
+    }
+
     for (size_t i = 0; i < n; ++i) {
-        if (x == forbidden_symbol_chars[i] || std::isspace(x)) {
+        if (x == forbidden_symbol_chars[i]) {
             return false;
         }
     }
@@ -35,14 +39,21 @@ static bool is_symbol_char(char x)
     return true;
 }
 
-// Advances the given iterator to the next character that is not whitespace in the string.
-std::string::const_iterator skip_whitespace(std::string::const_iterator begin){
-    return std::find_if(begin, str.end(), [](char c) { return !std::isspace(c); });
+// Advances the given cursor to the next character that is not whitespace.
+const char* skip_whitespace(const char* str)
+{
+    assert(str);
+
+    while (*str != 0 && std::isspace(static_cast<unsigned char>(*str))) {
+        str++;
+    }
+
+    return str;
 }
 
 // Identifies the next occurrence of a double quote character (") in the string,
 //  used to parse strings in the input.
-static const std::string next_quote(const std::string& str)
+static const char* next_quote(const char* str)
 {
     assert(str);
 
@@ -55,7 +66,7 @@ static const std::string next_quote(const std::string& str)
 
 // Advances through the string until a newline character is encountered, 
 // used for handling comments.
-static const std::string skip_until_newline(const std::string& str)
+static const char* skip_until_newline(const char* str)
 {
     assert(str);
 
@@ -68,15 +79,21 @@ static const std::string skip_until_newline(const std::string& str)
 
 // Finds the next character in the string that does not correspond to a symbol character, 
 // aiding in tokenization of the input.
-std::string::const_iterator next_non_symbol(std::string::const_iterator begin)
+const char* next_non_symbol(const char* str)
 {
-    return std::find_if_not(begin, str.end(), is_symbol_char);
+    assert(str);
+
+    while (is_symbol_char(*str)) {
+        str++;
+    }
+
+    return str;
 }
 
 // Parses the next token from the input string, 
 // applying rules for different token types such as symbols, strings, 
 // and special characters.
-Token next_token(const std::string& str)
+Token next_token(const char* str)
 {
     assert(str);
 
@@ -90,6 +107,10 @@ Token next_token(const std::string& str)
         str = skip_whitespace(str);
     }
 
+    if (*str == 0) {
+        return token(str, str);
+    }
+
     switch (*str) {
     case '(':
     case ')':
@@ -100,7 +121,7 @@ Token next_token(const std::string& str)
         return token(str, str + 1);
 
     case '"': {
-        const std::string str_end = next_quote(str + 1);
+        const char* str_end = next_quote(str + 1);
         return token(str, *str_end == 0 ? str_end : str_end + 1);
     }
 
@@ -108,4 +129,3 @@ Token next_token(const std::string& str)
         return token(str, next_non_symbol(str + 1));
     }
 }
-
@@ -1,7 +1,11 @@
 #ifndef TOKENIZER_H_
 #define TOKENIZER_H_
 
-#include <string>
+/*
+* Tokens are views into a single immutable, NUL-terminated source buffer.
+    Nothing here copies the input: every function takes and returns
+    cursors (const char*) into the buffer the caller owns.
+*/
 
 struct Token
 {
@@ -9,12 +13,9 @@ struct Token
     const char* end;
 };
 
-Token token(const std::string& begin, const std::string& end)
-Token next_token(const std::string& str);
-static bool is_symbol_char(char x);
-std::string::const_iterator skip_whitespace(std::string::const_iterator begin);
-static const std::string next_quote(const std::string& str)
-static const std::string skip_until_newline(const std::string& str);
-std::string::const_iterator next_non_symbol(std::string::const_iterator begin);
+Token token(const char* begin, const char* end);
+Token next_token(const char* str);
+const char* skip_whitespace(const char* str);
+const char* next_non_symbol(const char* str);
 
 #endif  // TOKENIZER_H_
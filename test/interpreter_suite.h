@@ -1,10 +1,76 @@
 #ifndef INTERPRETER_SUITE_H_
 #define INTERPRETER_SUITE_H_
 
+#include <sstream>
+#include <vector>
+
 #include "test.hpp"
 #include "builtins.hpp"
 #include "expr.hpp"
+#include "aot.hpp"
 #include "interpreter.hpp"
+#include "jit.hpp"
+#include "parser.hpp"
+#include "scope.hpp"
+#include "std.hpp"
+#include "tokenizer.hpp"
+
+// Evaluates the forms of `source` one by one at top level, stopping at the first error.
+// Like the repl, it reads each form just before evaluating it (see eval_top_level).
+static struct EvalResult eval_source(Gc* gc, struct Scope* scope, const char* source)
+{
+    struct EvalResult result = {};
+    const char* cursor = next_token(source).begin;
+
+    while (*cursor != 0) {
+        struct ParseResult parsed = read_expr_from_string(gc, cursor);
+        assert(!parsed.is_error);
+
+        result = eval_top_level(gc, scope, parsed.expr);
+        if (result.is_error) {
+            break;
+        }
+
+        cursor = next_token(parsed.end).begin;
+    }
+
+    return result;
+}
+
+// Checks that `source` evaluates to what `expected` reads as.
+static bool eval_yields(Gc* gc, struct Scope* scope, const char* source, const char* expected)
+{
+    struct EvalResult result = eval_source(gc, scope, source);
+    struct ParseResult value = read_expr_from_string(gc, expected);
+    assert(!value.is_error);
+
+    if (result.is_error || !equal(result.expr, value.expr)) {
+        fprintf(stderr, "\n%s\n  Expected: %s\n  Actual: %s", source, expected,
+                result.is_error ? "error " : "");
+        print_expr_as_sexpr(stderr, result.expr);
+        fprintf(stderr, "\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Checks that `source` fails with an error named `error`.
+static bool eval_fails_with(Gc* gc, struct Scope* scope, const char* source, const char* error)
+{
+    struct EvalResult result = eval_source(gc, scope, source);
+    struct Expr name = cons_p(result.expr) ? CAR(result.expr) : result.expr;
+
+    if (!result.is_error || !symbol_p(name) || name.atom->sym != error) {
+        fprintf(stderr, "\n%s\n  Expected: error %s\n  Actual: %s", source, error,
+                result.is_error ? "error " : "");
+        print_expr_as_sexpr(stderr, result.expr);
+        fprintf(stderr, "\n");
+        return false;
+    }
+
+    return true;
+}
 
 TEST(equal_test)
 {
@@ -47,6 +113,30 @@ TEST(equal_test)
     return 0;
 }
 
+TEST(nil_is_canonical_test)
+{
+    Gc* gc = create_gc();
+
+    struct Expr nil1 = NIL(gc);
+    struct Expr nil2 = SYMBOL(gc, "nil");
+    ASSERT_TRUE(nil1.atom == nil2.atom, {
+            fprintf(stderr, "nil was allocated twice\n");
+        });
+    ASSERT_TRUE(nil_p(bool_as_expr(false)), {
+            fprintf(stderr, "bool_as_expr(false) is not nil\n");
+        });
+    ASSERT_TRUE(T(gc).atom == bool_as_expr(true).atom, {
+            fprintf(stderr, "t was allocated twice\n");
+        });
+    ASSERT_FALSE(nil_p(SYMBOL(gc, "nilly")), {
+            fprintf(stderr, "nilly is not nil\n");
+        });
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
 TEST(assoc_test)
 {
     Gc* gc = create_gc();
@@ -225,15 +315,810 @@ TEST(match_list_singleton_tail_test)
     return 0;
 }
 
+TEST(weak_references_test)
+{
+    Gc* gc = create_gc();
+
+    struct Expr key = CONS(gc, INTEGER(gc, 1), NIL(gc));
+    struct Expr box = atom_as_expr(create_weak_box_atom(gc, CONS(gc, INTEGER(gc, 2), NIL(gc))));
+    struct Expr table = atom_as_expr(create_weak_table_atom(gc));
+
+    // The value refers to its key: an ephemeron still lets both go once the key is unreachable.
+    struct Expr dead_key = CONS(gc, INTEGER(gc, 3), NIL(gc));
+    table.atom->table->entries[expr_identity(key)] = std::make_pair(key, INTEGER(gc, 4));
+    table.atom->table->entries[expr_identity(dead_key)] = std::make_pair(dead_key, dead_key);
+
+    gc_collect(gc, list(gc, "eee", key, box, table));
+
+    ASSERT_TRUE(nil_p(box.atom->weak), {
+            fprintf(stderr, "weak box still refers to an unreachable cons\n");
+        });
+    ASSERT_LONGINTEQ(1L, (long int) table.atom->table->entries.size());
+    ASSERT_LONGINTEQ(4L, table.atom->table->entries[expr_identity(key)].second.atom->num);
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(weak_table_keys_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    ASSERT_FALSE(eval_source(gc, &scope,
+                             "(set table (make-weak-table))"
+                             "(set key (list 1))"
+                             "(weak-table-put table key 'found)"
+                             "(weak-table-put table nil 'empty)").is_error, {});
+
+    // Keys are compared by identity, nil and t are unique.
+    ASSERT_TRUE(eval_yields(gc, &scope, "(weak-table-get table key)", "found"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(weak-table-get table (list 1))", "nil"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(weak-table-get table nil)", "empty"), {});
+
+    // Symbols and numbers are rejected rather than missed.
+    ASSERT_TRUE(eval_yields(gc, &scope, "(condition-case e (weak-table-get table 42) (error e))",
+                            "(wrong-argument-type weak-key-p 42)"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(weak-table-put table 'name 1)", "wrong-argument-type"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(weak-table-remove table 1.5)", "wrong-argument-type"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(weak-table-count table)", "2"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(request_forwarding_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+    gc->request_per_form = true;
+
+    ASSERT_FALSE(eval_source(gc, &scope,
+                             "(set t1 (make-weak-table))"
+                             "(set t2 (make-weak-table))"
+                             "(set kept nil)").is_error, {});
+
+    // Two barriers and the end of the request each move the key out of the region,
+    // all three must get the same copy.
+    ASSERT_FALSE(eval_source(gc, &scope,
+                             "(let ((k (list 1 2))) (weak-table-put t1 k 'a) (weak-table-put t2 k 'b) (set kept k))").is_error, {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(list (weak-table-get t1 kept) (weak-table-get t2 kept))", "(a b)"), {});
+
+    // A barrier copies a string or builder, the request keeps using the original.
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(let ((s (string-append \"hel\" \"lo\"))) (set kept s) (string-append s \"!\"))",
+                            "\"hello!\""), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "kept", "\"hello\""), {});
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(let ((b (make-string-builder))) (sb-append! b \"x\") (set kept b) (sb-append! b \"y\") (sb->string b))",
+                            "\"xy\""), {});
+
+    // Builders and weak tables are mutable: changes after the copy reach it.
+    ASSERT_TRUE(eval_yields(gc, &scope, "(sb->string kept)", "\"xy\""), {});
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(let ((sb (make-string-builder))) (set g sb) (sb-append! sb \"x\") (sb-length sb))",
+                            "1"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(sb->string g)", "\"x\""), {});
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(let ((tb (make-weak-table)) (k (list 1)))"
+                            "  (set kept tb) (set kept-key k) (weak-table-put tb k 'v) (weak-table-get tb k))",
+                            "v"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(list (weak-table-get kept kept-key) (weak-table-count kept))", "(v 1)"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(heap_census_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    ASSERT_FALSE(eval_source(gc, &scope,
+                             "(set greeting \"hello world\")"
+                             "(set numbers (list 1 2 3))").is_error, {});
+
+    const HeapCensus census = gc_census(gc);
+    const size_t string_kind = 1 + ATOM_STRING;
+
+    ASSERT_TRUE(strcmp(heap_kind_name(0), "cons") == 0, {});
+    ASSERT_TRUE(strcmp(heap_kind_name(string_kind), "string") == 0, {});
+    ASSERT_TRUE(census.counts[0] >= 3, {});
+    ASSERT_TRUE(census.counts[string_kind] >= 1, {});
+    ASSERT_TRUE(census.bytes[string_kind] >= census.counts[string_kind] * sizeof(Atom) + strlen("hello world"), {});
+
+    std::ostringstream dump;
+    gc_dump(gc, scope.expr, dump);
+    const std::string text = dump.str();
+
+    ASSERT_TRUE(text.rfind("lisp-heap 1\n", 0) == 0, {});
+    ASSERT_TRUE(text.find(" string ") != std::string::npos && text.find(" hello world\n") != std::string::npos, {
+            fprintf(stderr, "no record of the string in the dump\n");
+        });
+    ASSERT_TRUE(text.find("\ne ") != std::string::npos, {});
+    ASSERT_TRUE(text.find(" greeting\n") != std::string::npos && text.find(" numbers\n") != std::string::npos, {
+            fprintf(stderr, "global bindings are not retainer roots of the dump\n");
+        });
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(macro_expansion_cache_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(defmacro twice (x) (list '+ x x))"
+                            "(defun f (y) (twice y))"
+                            "(f 3)",
+                            "6"), {});
+    ASSERT_LONGINTEQ(1L, (long int) gc->macro_expansions.size());
+
+    // The call site is expanded once, not once per call.
+    ASSERT_TRUE(eval_yields(gc, &scope, "(f 4)", "8"), {});
+    ASSERT_LONGINTEQ(1L, (long int) gc->macro_expansions.size());
+
+    // Redefining the macro makes the cached expansion stale.
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(defmacro twice (x) (list '* x x))"
+                            "(f 3)",
+                            "9"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(constant_folding_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(defconst minutes 60)"
+                            "(defun seconds-per-day () (* minutes 60 24))"
+                            "(seconds-per-day)",
+                            "86400"), {});
+
+    struct Expr fn = CDR(get_scope_value(&scope, SYMBOL(gc, "seconds-per-day")));
+    ASSERT_TRUE(equal(fn.atom->lambda.optimized, list(gc, "d", 86400)), {
+            fprintf(stderr, "Body was not folded: ");
+            print_expr_as_sexpr(stderr, fn.atom->lambda.optimized);
+            fprintf(stderr, "\n");
+        });
+
+    // Rebinding the constant invalidates the folded body.
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(defconst minutes 1)"
+                            "(seconds-per-day)",
+                            "1440"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(inline_call_keeps_evaluation_order_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    // The argument runs before anything the inlined body calls.
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(set order nil)"
+                            "(defun g () (set order (append order '(g))))"
+                            "(defun h () (set order (append order '(h))) 1)"
+                            "(defun f (a) (begin (g) a))"
+                            "(defun caller () (f (h)))"
+                            "(caller)"
+                            "order",
+                            "(h g)"), {});
+
+    // A variable argument is read before the body can change it.
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(set x 1)"
+                            "(defun set-x () (set x 2))"
+                            "(defun f2 (a) (begin (set-x) a))"
+                            "(defun caller2 () (f2 x))"
+                            "(caller2)",
+                            "1"), {});
+
+    // An argument the body never reads is still evaluated.
+    ASSERT_TRUE(eval_fails_with(gc, &scope,
+                                "(defun k (a) 1)"
+                                "(defun caller3 () (k undefined-variable))"
+                                "(caller3)",
+                                "void-variable"), {});
+
+    // Reads before any call are still inlined.
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(defun sq (n) (* n n))"
+                            "(defun caller4 (y) (sq y))"
+                            "(caller4 3)",
+                            "9"), {});
+
+    struct Expr caller4 = CDR(get_scope_value(&scope, SYMBOL(gc, "caller4")));
+    ASSERT_TRUE(equal(caller4.atom->lambda.optimized, list(gc, "e", list(gc, "qqq", "*", "y", "y"))), {
+            fprintf(stderr, "sq was not inlined: ");
+            print_expr_as_sexpr(stderr, caller4.atom->lambda.optimized);
+            fprintf(stderr, "\n");
+        });
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(inline_call_skips_macro_bodies_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    // The macro sees the parameter, not the caller's argument form.
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(defmacro form-of (x) (list 'quote x))"
+                            "(defun show (a) (form-of a))"
+                            "(defun caller () (show (+ 1 2)))"
+                            "(caller)",
+                            "a"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(jit_recursion_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(defun fact (n) (if (> 2 n) 1 (* n (fact (+ n -1)))))"
+                            "(fact 5)",
+                            "120"), {});
+
+    struct Expr fact = CDR(get_scope_value(&scope, SYMBOL(gc, "fact")));
+    JitCode* code = jit_compile(gc, fact.atom);
+
+#if defined(__x86_64__) && defined(__linux__)
+    ASSERT_TRUE(code != NULL, {
+            fprintf(stderr, "fact was not compiled\n");
+        });
+
+    long int value = 0;
+    ASSERT_TRUE(jit_run(gc, code, list(gc, "d", 10), &value), {
+            fprintf(stderr, "(fact 10) deoptimized\n");
+        });
+    ASSERT_LONGINTEQ(3628800L, value);
+
+    // 25! does not fit in 64 bits: the code deoptimizes instead of wrapping around.
+    ASSERT_FALSE(jit_run(gc, code, list(gc, "d", 25), &value), {
+            fprintf(stderr, "(fact 25) did not deoptimize\n");
+        });
+#else
+    ASSERT_TRUE(code == NULL, {
+            fprintf(stderr, "compiled on a host without a JIT\n");
+        });
+#endif
+
+    jit_release(code);
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(jit_deopt_limit_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    // Every call deoptimizes: the if has no else forms and 0 is not positive.
+    std::ostringstream calls;
+    calls << "(dotimes (i " << JIT_CALL_THRESHOLD + JIT_DEOPT_LIMIT << ") (positive-or-nil 0))";
+    ASSERT_FALSE(eval_source(gc, &scope, "(defun positive-or-nil (x) (if (> x 0) x))").is_error, {});
+    ASSERT_TRUE(eval_yields(gc, &scope, calls.str().c_str(), "nil"), {});
+
+    struct Expr fn = CDR(get_scope_value(&scope, SYMBOL(gc, "positive-or-nil")));
+    ASSERT_TRUE(fn.atom->lambda.jit == NULL, {
+            fprintf(stderr, "code that always deoptimizes was kept\n");
+        });
+
+#if defined(__x86_64__) && defined(__linux__)
+    ASSERT_LONGINTEQ((long int) JIT_DEOPT_LIMIT, fn.atom->lambda.deopts);
+#endif
+
+    // It stays interpreted, and still right, until the epoch changes.
+    ASSERT_TRUE(eval_yields(gc, &scope, calls.str().c_str(), "nil"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(positive-or-nil 3)", "3"), {});
+    ASSERT_TRUE(fn.atom->lambda.jit == NULL, {
+            fprintf(stderr, "the code was compiled again in the same epoch\n");
+        });
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(aot_bind_args_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    struct Expr params[2];
+    struct EvalResult result = aot_bind_args(gc, list(gc, "dd", 1, 2), params, 2);
+    ASSERT_FALSE(result.is_error, {
+            print_expr_as_sexpr(stderr, result.expr);
+            fprintf(stderr, "\n");
+        });
+    ASSERT_LONGINTEQ(2L, params[1].atom->num);
+
+    // Compiled functions reject a wrong argument count exactly like interpreted ones.
+    struct EvalResult interpreted = eval_source(gc, &scope, "(defun two (a b) a) (two 1 2 3)");
+    result = aot_bind_args(gc, list(gc, "ddd", 1, 2, 3), params, 2);
+    ASSERT_TRUE(result.is_error && interpreted.is_error && equal(result.expr, interpreted.expr), {
+            print_expr_as_sexpr(stderr, result.expr);
+            fprintf(stderr, "\n");
+        });
+
+    interpreted = eval_source(gc, &scope, "(two 1)");
+    result = aot_bind_args(gc, list(gc, "d", 1), params, 2);
+    ASSERT_TRUE(result.is_error && interpreted.is_error && equal(result.expr, interpreted.expr), {
+            print_expr_as_sexpr(stderr, result.expr);
+            fprintf(stderr, "\n");
+        });
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+// Like the code aot_compile_files generates for (defun ping () (pong)) and back.
+static struct EvalResult aot_ping(void* param, Gc* gc, struct Scope* scope, struct Expr args)
+{
+    (void) param;
+    (void) args;
+    return aot_call(gc, scope, "pong", NIL(gc));
+}
+
+static struct EvalResult aot_pong(void* param, Gc* gc, struct Scope* scope, struct Expr args)
+{
+    (void) param;
+    (void) args;
+    return aot_call(gc, scope, "ping", NIL(gc));
+}
+
+TEST(aot_call_depth_limit_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+    gc->max_eval_depth = 100;
+
+    aot_define(gc, &scope, "ping", aot_ping);
+    aot_define(gc, &scope, "pong", aot_pong);
+
+    // Compiled functions recursing into each other end in stack-overflow, not a crash.
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(ping)", "stack-overflow"), {});
+    ASSERT_TRUE(gc->eval_depth == 0, {
+            fprintf(stderr, "eval_depth left at %zu\n", (size_t) gc->eval_depth);
+        });
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(loop_forms_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(set n 0)"
+                            "(while (> 5 n) (set n (+ n 1)))"
+                            "n",
+                            "5"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(while nil 1)", "nil"), {});
+
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(set sum 0)"
+                            "(dotimes (i 5) (set sum (+ sum i)))"
+                            "sum",
+                            "10"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(dotimes (i 3 i))", "3"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(dotimes (i 'x))", "wrong-argument-type"), {});
+
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(set squares nil)"
+                            "(dolist (x '(1 2 3)) (set squares (append squares (list (* x x)))))"
+                            "squares",
+                            "(1 4 9)"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(dolist (x '(1 2) x))", "nil"), {});
+
+    // Empty bodies still spend a step per iteration.
+    gc->step_limit = 1000;
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(dotimes (i 1000000000))", "fuel-exhausted"), {});
+
+    std::string dolist = "(dolist (x '(";
+    for (int i = 0; i < 5000; ++i) {
+        dolist += "1 ";
+    }
+    dolist += ")))";
+    ASSERT_TRUE(eval_fails_with(gc, &scope, dolist.c_str(), "fuel-exhausted"), {});
+    gc->step_limit = 0;
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(let_forms_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    // let evaluates every init in the enclosing scope, let* sees the earlier bindings.
+    ASSERT_TRUE(eval_yields(gc, &scope, "(set x 1) (let ((x 2) (y x)) y)", "1"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(let* ((x 2) (y x)) y)", "2"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(let (z) z)", "nil"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "x", "1"), {});
+
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(letrec ((f (lambda (n) (if (> n 0) (f (+ n -1)) 'done)))) (f 3))",
+                            "done"), {});
+
+    // The frame is popped on errors too.
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(let ((x 5)) undefined-variable)", "void-variable"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "x", "1"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(conditional_forms_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    ASSERT_TRUE(eval_yields(gc, &scope, "(if (> 2 1) 'yes 'no)", "yes"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(if nil 'yes 'no 'else)", "else"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(if nil 'yes)", "nil"), {});
+
+    ASSERT_TRUE(eval_yields(gc, &scope, "(cond (nil 1) ((> 2 1) 2) (t 3))", "2"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(cond (nil 1) (5))", "5"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(cond (nil 1))", "nil"), {});
+
+    ASSERT_TRUE(eval_yields(gc, &scope, "(and)", "t"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(and 1 2 3)", "3"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(and 1 nil undefined-variable)", "nil"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(or)", "nil"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(or nil 2 undefined-variable)", "2"), {});
+
+    // Every case form is evaluated twice: once to build its table, once from the cache.
+    const char* cases[][2] = {
+        {"(case 2 (1 'one) ((2 3) 'two-or-three) (t 'other))", "two-or-three"},
+        {"(case 'b (a 1) ((b c) 2) (otherwise 3))", "2"},
+        {"(case '(1 2) ((1) 'one) (((1 2)) 'pair) (t 'other))", "pair"},
+        {"(case 9 (1 'one) (t 'other))", "other"},
+        {"(case 9 (1 'one))", "nil"},
+        {"(case 1 (1 'first) (1 'second))", "first"},
+        {"(case 1 (t 'a) (1 'b))", "a"},
+        {"(case 'x (otherwise 'a) (x 'b))", "a"},
+    };
+
+    for (const auto& test : cases) {
+        const std::string defun = std::string("(defun case-test () ") + test[0] + ")";
+        ASSERT_FALSE(eval_source(gc, &scope, defun.c_str()).is_error, {
+                fprintf(stderr, "%s failed\n", defun.c_str());
+            });
+        ASSERT_TRUE(eval_yields(gc, &scope, "(case-test)", test[1]), {});
+        ASSERT_TRUE(eval_yields(gc, &scope, "(case-test)", test[1]), {});
+    }
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(non_local_exit_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    ASSERT_FALSE(eval_source(gc, &scope,
+                             "(defun thrower (x) (throw 'done x))"
+                             "(defun middle (x) (thrower x) 'not-reached)"
+                             "(defun one-arg (x) x)").is_error, {});
+
+    // A throw unwinds through the frames of both lambdas and through a condition-case.
+    ASSERT_TRUE(eval_yields(gc, &scope, "(catch 'done (middle 42))", "42"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(catch 'done (condition-case e (thrower 7) (error 'swallowed)))", "7"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(catch 'outer (catch 'done (throw 'outer 1)) 2)", "1"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(thrower 1)", "no-catch"), {});
+
+    // Errors are matched by their head symbol and only built when bound.
+    ASSERT_TRUE(eval_yields(gc, &scope, "(condition-case e (car 1) (wrong-argument-type e))",
+                            "(wrong-argument-type consp 1)"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(condition-case nil (car 1) ((void-variable wrong-argument-type) 'handled))",
+                            "handled"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(condition-case e (one-arg) (error e))",
+                            "(wrong-integer-of-arguments . 0)"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(condition-case e (car 1) (t (condition-case f (one-arg 1 2) (t (list e f)))))",
+                            "((wrong-argument-type consp 1) (wrong-integer-of-arguments . 2))"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(condition-case e (car 1) (no-catch 'x))", "wrong-argument-type"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(car 1)", "wrong-argument-type"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(eval_depth_limit_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+    gc->max_eval_depth = 100;
+
+    ASSERT_FALSE(eval_source(gc, &scope, "(defun down (n) (if (> n 0) (+ 1 (down (+ n -1))) 0))").is_error, {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(down 50)", "50"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(down 1000000)", "stack-overflow"), {});
+
+    // No eval stack can be reserved for this limit, the thread's stack must not overflow instead.
+    gc->max_eval_depth = SIZE_MAX / EVAL_STACK_BYTES_PER_LEVEL;
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(down 100000000)", "stack-overflow"), {});
+    ASSERT_TRUE(gc->max_eval_depth == SIZE_MAX / EVAL_STACK_BYTES_PER_LEVEL, {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(memory_limits_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    ASSERT_FALSE(eval_source(gc, &scope,
+                             "(set big nil)"
+                             "(dotimes (i 2000) (set big (append (list i) big)))"
+                             "(set xs nil)"
+                             "(set kept nil)").is_error, {});
+
+    gc->allocation_quota = 64 * 1024;
+
+    // Conses, a native that allocates in a loop of its own, and string payloads.
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(dotimes (i 1000000) (set xs (list i xs)))", "memory-exhausted"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(list (append big big big big big big big big))", "memory-exhausted"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope,
+                                "(begin (set s \"0123456789abcdef\") (dotimes (i 20) (set s (string-append s s))))",
+                                "memory-exhausted"), {});
+
+    // The quota is per form and the interpreter is left consistent.
+    ASSERT_TRUE(eval_yields(gc, &scope, "(+ 1 2)", "3"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(catch 'done (throw 'done 'ok))", "ok"), {});
+
+    gc->allocation_quota = 0;
+    gc->heap_limit = gc->heap_bytes + 64 * 1024;
+
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(dotimes (i 1000000) (set kept (list i kept)))", "memory-exhausted"), {});
+    ASSERT_TRUE(gc->heap_bytes <= gc->heap_limit, {
+            fprintf(stderr, "%zu bytes left after the collection\n", gc->heap_bytes);
+        });
+    ASSERT_TRUE(eval_yields(gc, &scope, "(set kept nil)", "nil"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(list_runs_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    // A long list is laid out as runs of adjacent conses and ends in the given tail.
+    std::vector<struct Expr> items;
+    for (long int i = 0; i < 1000; ++i) {
+        items.push_back(INTEGER(gc, i));
+    }
+
+    struct Expr tail = CONS(gc, INTEGER(gc, 1000), NIL(gc));
+    struct Expr xs = list_from_array(gc, items.data(), items.size(), tail);
+
+    size_t adjacent = 0;
+    long int i = 0;
+    for (struct Expr it = xs; it.cons != tail.cons; it = CDR(it), ++i) {
+        ASSERT_LONGINTEQ(i, CAR(it).atom->num);
+        adjacent += CDR(it).cons == it.cons + 1;
+    }
+    ASSERT_LONGINTEQ(1000L, i);
+    ASSERT_LONGINTEQ(1001L, length_of_list(xs));
+    ASSERT_TRUE(adjacent >= 990, {
+            fprintf(stderr, "only %zu of 1000 conses follow their predecessor\n", adjacent);
+        });
+    ASSERT_TRUE(list_from_array(gc, items.data(), 0, tail).cons == tail.cons, {});
+
+    // append copies all but the last list, which it shares.
+    ASSERT_TRUE(eval_yields(gc, &scope, "(append '(1 2) '(3) '() '(4 5))", "(1 2 3 4 5)"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(append)", "nil"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(append '(1) 2)", "(1 . 2)"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(append 1 '(2))", "wrong-argument-type"), {});
+
+    struct Expr last = eval_source(gc, &scope, "(set last-list (list 3 4))").expr;
+    struct EvalResult appended = eval_source(gc, &scope, "(append (list 1 2) last-list)");
+    ASSERT_FALSE(appended.is_error, {});
+    ASSERT_TRUE(CDR(CDR(appended.expr)).cons == last.cons, {});
+
+    // quasiquote, with a dotted unquoted tail.
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(set x 2)"
+                            "(set ys (list 3 4))"
+                            "`(1 ,x (a ,x) . ,ys)",
+                            "(1 2 (a 2) 3 4)"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(string_builder_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(set sb (make-string-builder))"
+                            "(sb-append! sb \"ab\" \"cd\")"
+                            "(sb-append! sb \"\")"
+                            "(list (sb-length sb) (sb->string sb) (sb->string sb))",
+                            "(4 \"abcd\" \"abcd\")"), {});
+
+    // Appending after flattening continues the same text.
+    ASSERT_TRUE(eval_yields(gc, &scope, "(sb->string (sb-append! sb \"e\"))", "\"abcde\""), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(sb-length (sb-append! (make-string-builder) \"xyz\"))", "3"), {});
+    ASSERT_TRUE(eval_yields(gc, &scope, "(sb->string (make-string-builder))", "\"\""), {});
+
+    // A long string is kept by reference: alone it is the result itself, mixed it is copied once.
+    const std::string long_text(ROPE_SHARE_THRESHOLD + 44, 'x');
+    const std::string define = "(set long \"" + long_text + "\")";
+    struct Expr long_string = eval_source(gc, &scope, define.c_str()).expr;
+
+    struct EvalResult alone = eval_source(gc, &scope, "(sb->string (sb-append! (make-string-builder) long))");
+    ASSERT_FALSE(alone.is_error, {});
+    ASSERT_TRUE(alone.expr.atom == long_string.atom, {});
+
+    ASSERT_TRUE(eval_yields(gc, &scope,
+                            "(string-length (sb->string (sb-append! (make-string-builder) \"<\" long \">\")))",
+                            std::to_string(long_text.size() + 2).c_str()), {});
+
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(sb-append! sb 1)", "wrong-argument-type"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(sb-length \"sb\")", "wrong-argument-type"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(sb->string nil)", "wrong-argument-type"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(string_natives_test)
+{
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    const char* values[][2] = {
+        {"(substring \"hello\" 1 3)", "\"el\""},
+        {"(substring \"hello\" 2)", "\"llo\""},
+        {"(substring \"hello\" 5)", "\"\""},
+        {"(substring \"hello\" 0 5)", "\"hello\""},
+
+        {"(string-index \"banana\" \"an\")", "1"},
+        {"(string-index \"banana\" \"an\" 2)", "3"},
+        {"(string-index \"banana\" \"a\" 6)", "nil"},
+        {"(string-index \"banana\" \"x\")", "nil"},
+        {"(string-index \"banana\" \"\" 2)", "2"},
+        {"(string-index \"banana\" \"\" 6)", "6"},
+
+        {"(string-split \"a,,b,\" \",\")", "(\"a\" \"\" \"b\" \"\")"},
+        {"(string-split \",a\" \",\")", "(\"\" \"a\")"},
+        {"(string-split \"\" \",\")", "(\"\")"},
+        {"(string-split \"a::b\" \"::\")", "(\"a\" \"b\")"},
+
+        {"(string-join (list \"a\" \"\" \"b\") \"-\")", "\"a--b\""},
+        {"(string-join nil \"-\")", "\"\""},
+        {"(string-append \"ab\" \"\" \"c\")", "\"abc\""},
+        {"(string-length \"\")", "0"},
+
+        {"(string->number \"42\")", "42"},
+        {"(string->number \"-7\")", "-7"},
+        {"(string->number \"1.5\")", "1.5"},
+        {"(string->number \"12x\")", "nil"},
+        {"(string->number \"\")", "nil"},
+        {"(number->string 42)", "\"42\""},
+    };
+
+    for (const auto& test : values) {
+        ASSERT_TRUE(eval_yields(gc, &scope, test[0], test[1]), {});
+    }
+
+    const char* out_of_range[] = {
+        "(substring \"hello\" 3 2)",
+        "(substring \"hello\" -1)",
+        "(substring \"hello\" 0 6)",
+        "(string-index \"banana\" \"a\" 7)",
+        "(string-index \"banana\" \"a\" -1)",
+        "(string-split \"a\" \"\")",
+    };
+
+    for (const char* source : out_of_range) {
+        ASSERT_TRUE(eval_fails_with(gc, &scope, source, "args-out-of-range"), {});
+    }
+
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(string-index 1 \"a\")", "wrong-argument-type"), {});
+    ASSERT_TRUE(eval_fails_with(gc, &scope, "(string-join (list \"a\" 1) \",\")", "wrong-argument-type"), {});
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
 TEST_SUITE(interpreter_suite)
 {
     TEST_RUN(equal_test);
+    TEST_RUN(nil_is_canonical_test);
     TEST_RUN(assoc_test);
     TEST_RUN(match_list_test);
     TEST_RUN(match_list_empty_list_test);
     TEST_RUN(match_list_head_tail_test);
     TEST_RUN(match_list_wildcard_test);
     TEST_RUN(match_list_singleton_tail_test);
+    TEST_RUN(weak_references_test);
+    TEST_RUN(weak_table_keys_test);
+    TEST_RUN(request_forwarding_test);
+    TEST_RUN(heap_census_test);
+    TEST_RUN(macro_expansion_cache_test);
+    TEST_RUN(constant_folding_test);
+    TEST_RUN(inline_call_keeps_evaluation_order_test);
+    TEST_RUN(inline_call_skips_macro_bodies_test);
+    TEST_RUN(jit_recursion_test);
+    TEST_RUN(jit_deopt_limit_test);
+    TEST_RUN(aot_bind_args_test);
+    TEST_RUN(aot_call_depth_limit_test);
+    TEST_RUN(loop_forms_test);
+    TEST_RUN(let_forms_test);
+    TEST_RUN(conditional_forms_test);
+    TEST_RUN(non_local_exit_test);
+    TEST_RUN(eval_depth_limit_test);
+    TEST_RUN(memory_limits_test);
+    TEST_RUN(list_runs_test);
+    TEST_RUN(string_builder_test);
+    TEST_RUN(string_natives_test);
 
     return 0;
 }
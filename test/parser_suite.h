@@ -5,6 +5,9 @@
 #include "parser.hpp"
 #include "gc.hpp"
 #include "builtins.hpp"
+#include "interpreter.hpp"
+#include "scope.hpp"
+#include "std.hpp"
 
 TEST(read_expr_from_file_test)
 {
@@ -252,6 +255,56 @@ TEST(read_all_exprs_from_string_trailing_spaces_test)
     return 0;
 }
 
+TEST(read_all_exprs_from_string_error_position_test)
+{
+    Gc* gc = create_gc();
+    const char* source_code = "(+ 1 2) \"unclosed";
+    struct ParseResult result = read_all_exprs_from_string(gc, source_code);
+
+    ASSERT_TRUE(result.is_error, {
+            fprintf(stderr, "Parsing didn't fail as expected\n");
+        });
+
+    ASSERT_TRUE(result.end == source_code + 8, {
+            fprintf(stderr, "Expected position: 8\n");
+            fprintf(stderr, "Actual position: %zd\n", result.end - source_code);
+        });
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(load_read_error_position_test)
+{
+    const char* filename = "load-read-error-test.ebi";
+    FILE* file = fopen(filename, "wb");
+    ASSERT_TRUE(file != NULL, {
+            fprintf(stderr, "Could not create %s\n", filename);
+        });
+    fputs("(+ 1 2) \"unclosed", file);
+    fclose(file);
+
+    Gc* gc = create_gc();
+    struct Scope scope = create_scope(gc);
+    load_std_library(gc, &scope);
+
+    struct ParseResult form = read_expr_from_string(gc, "(load \"load-read-error-test.ebi\")");
+    struct EvalResult result = eval_top_level(gc, &scope, form.expr);
+    remove(filename);
+
+    struct ParseResult expected = read_expr_from_string(gc, "(read-error \"Unclosed string\" 8)");
+    ASSERT_TRUE(result.is_error && equal(result.expr, expected.expr), {
+            fprintf(stderr, "Actual: ");
+            print_expr_as_sexpr(stderr, result.expr);
+            fprintf(stderr, "\n");
+        });
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
 TEST_SUITE(parser_suite)
 {
     TEST_RUN(read_expr_from_file_test);
@@ -262,6 +315,8 @@ TEST_SUITE(parser_suite)
     // TODO(#467): read_all_exprs_from_string_bad_test is failing
     TEST_IGNORE(read_all_exprs_from_string_bad_test);
     TEST_RUN(read_all_exprs_from_string_trailing_spaces_test);
+    TEST_RUN(read_all_exprs_from_string_error_position_test);
+    TEST_RUN(load_read_error_position_test);
     TEST_RUN(parse_reals_test);
     TEST_RUN(parse_real_pair_test);
 
@@ -45,9 +45,69 @@ TEST(set_scope_value_test)
     return 0;
 }
 
+TEST(scope_escape_test)
+{
+    Gc* gc = create_gc();
+
+    struct Expr x = SYMBOL(gc, "x");
+
+    struct Scope scope = {
+        .expr = CONS(gc, NIL(gc), NIL(gc))
+    };
+
+    const size_t mark = region_mark(gc);
+    push_region_scope_frame(gc, &scope, list(gc, "e", x), list(gc, "d", 42));
+
+    ASSERT_TRUE(region_owns(gc, scope.expr.cons),
+        { fprintf(stderr, "Frame was not allocated in the region\n"); });
+
+    scope_escape(gc, &scope);
+    region_release(gc, mark);
+
+    ASSERT_FALSE(region_owns(gc, scope.expr.cons),
+        { fprintf(stderr, "Frame is still in the region\n"); });
+    ASSERT_TRUE(equal(CONS(gc, x, INTEGER(gc, 42)), get_scope_value(&scope, x)),
+        { fprintf(stderr, "Unexpected value of `x`\n"); });
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
+TEST(closure_scope_test)
+{
+    Gc* gc = create_gc();
+
+    struct Expr x = SYMBOL(gc, "x");
+    struct Expr y = SYMBOL(gc, "y");
+
+    struct Scope scope = {
+        .expr = CONS(gc, NIL(gc), NIL(gc))
+    };
+
+    push_scope_frame(gc, &scope,
+        list(gc, "ee", x, y),
+        list(gc, "dd", 1, 2));
+
+    struct Scope closure = {
+        .expr = closure_scope(gc, &scope, NIL(gc), list(gc, "qe", "+", x))
+    };
+
+    ASSERT_TRUE(get_scope_value(&closure, x).cons == get_scope_value(&scope, x).cons,
+        { fprintf(stderr, "`x` is not shared with the enclosing scope\n"); });
+    ASSERT_TRUE(nil_p(get_scope_value(&closure, y)),
+        { fprintf(stderr, "`y` was captured without being mentioned\n"); });
+
+    destroy_gc(gc);
+
+    return 0;
+}
+
 TEST_SUITE(scope_suite)
 {
     TEST_RUN(set_scope_value_test);
+    TEST_RUN(scope_escape_test);
+    TEST_RUN(closure_scope_test);
 
     return 0;
 }